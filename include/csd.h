@@ -9,8 +9,8 @@
 /*                                       */
 /*****************************************/
 
-#include <setjmp.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -19,34 +19,66 @@
 #define CSD_H
 
 #if defined(__GNUC__) || defined(__clang__)
-#define csd_noreturn __attribute__((noreturn))
+#define csd_printf_like(fmt, args) __attribute__((format(printf, fmt, args)))
 #else
-#define csd_noreturn
+#define csd_printf_like(fmt, args)
 #endif
 
-#if defined(__GNUC__) || defined(__clang__)
-#define csd_printf_like(fmt, args) __attribute__((format(printf, fmt, args)))
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static inline int csd_ctz64(uint64_t bits)
+{
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+}
 #else
-#define csd_printf_like(fmt, args)
+#define csd_ctz64(bits) __builtin_ctzll(bits)
 #endif
 
 #define csd_write_malloc_init_cap 512
+#define csd_sequence_linear_max 8
+#define csd_hash_basis 2166136261u
+#define csd_hash_prime 16777619u
+#define csd_index_block_size 64
+#define csd_index_window_blocks 1024
+#define csd_mmap_threshold (1 << 20)
+#define csd_parallel_min_chunk (1 << 16)
+#define csd_parallel_min_size (1 << 18)
+#define csd_parallel_max_threads 64
+#define csd_default_max_depth 1024
+#define csd_parse_stack_frames 32
+#define csd_arena_chunk_min 4096
+#define csd_arena_chunk_max (1 << 20)
 #define csd_reason_size 512
 #define csd_array_sizeof(x) (sizeof(x) / sizeof(x[0]))
 
 static const char *csd_escape_sequences = "\a\b\e\f\n\r\t\v\?\\\"";
-static const char *csd_escape_sequence_to_char[255] = {
+static const char *csd_escape_sequence_to_char[256] = {
     ['\a'] = "\\a", ['\b'] = "\\b", ['\e'] = "\\e",  ['\f'] = "\\f",
     ['\n'] = "\\n", ['\r'] = "\\r", ['\t'] = "\\t",  ['\v'] = "\\v",
-    ['\?'] = "\\?", ['\\'] = "\\",  ['\"'] = "\\\"",
+    ['\?'] = "\\?", ['\\'] = "\\\\", ['\"'] = "\\\"",
 };
-static char csd_char_to_escape_sequence[255] = {
+static char csd_char_to_escape_sequence[256] = {
     ['a'] = '\a', ['b'] = '\b', ['e'] = '\e', ['f'] = '\f',  ['n'] = '\n',  ['r'] = '\r',
-    ['t'] = '\t', ['v'] = '\v', ['?'] = '\?', ['\\'] = '\\', ['\''] = '\'',
+    ['t'] = '\t', ['v'] = '\v', ['?'] = '\?', ['\\'] = '\\', ['\''] = '\'', ['"'] = '"',
 };
-static bool csd_is_char_escape_sequence[255] = {
+static bool csd_is_char_escape_sequence[256] = {
     ['a'] = true, ['b'] = true, ['e'] = true, ['f'] = true,  ['n'] = true,  ['r'] = true,
-    ['t'] = true, ['v'] = true, ['?'] = true, ['\\'] = true, ['\"'] = true,
+    ['t'] = true, ['v'] = true, ['?'] = true, ['\\'] = true, ['\''] = true, ['"'] = true,
+};
+
+#define csd_digit_none 0xff
+/* the bytes between the digit runs are none, no entry is set twice */
+static const uint8_t csd_digit_values[256] = {
+    [0 ... '0' - 1] = csd_digit_none,
+    ['0'] = 0,  ['1'] = 1,  ['2'] = 2,  ['3'] = 3,  ['4'] = 4,  ['5'] = 5,
+    ['6'] = 6,  ['7'] = 7,  ['8'] = 8,  ['9'] = 9,
+    ['9' + 1 ... 'A' - 1] = csd_digit_none,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+    ['F' + 1 ... 'a' - 1] = csd_digit_none,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['f' + 1 ... 255] = csd_digit_none,
 };
 
 typedef enum csd_error
@@ -55,8 +87,19 @@ typedef enum csd_error
     csd_file_error,
     csd_scan_error,
     csd_write_overflow,
+    csd_memory_error,
+    csd_pool_error,
 } csd_error;
 
+/* realloc also allocates from null, a null allocator is malloc, realloc and free */
+typedef struct csd_allocator
+{
+    void *(*alloc)(void *user, size_t size);
+    void *(*realloc)(void *user, void *p, size_t size);
+    void (*free)(void *user, void *p);
+    void *user;
+} csd_allocator;
+
 typedef enum csd_type
 {
     csd_type_nil,
@@ -69,7 +112,7 @@ typedef enum csd_type
     csd_type_end,
 } csd_type;
 
-#define csd_bit(n) (1 << n)
+#define csd_bit(n) (1 << (n))
 typedef enum csd_token_type
 {
     csd_token_none = csd_bit(0),
@@ -99,27 +142,101 @@ typedef struct csd_token
     csd_token_type type;
     char *expr;
     size_t size;
-    int line;
-    int column;
+    size_t offset;
+    uint32_t hash;
+    bool escaped;
     bool ok;
 } csd_token;
 
+typedef struct csd_keyword
+{
+    const char *word;
+    csd_token_type type;
+    size_t size;
+} csd_keyword;
+
+typedef enum csd_index_class
+{
+    csd_index_whitespace = csd_bit(0),
+    csd_index_structural = csd_bit(1),
+    csd_index_quote = csd_bit(2),
+    csd_index_backslash = csd_bit(3),
+} csd_index_class;
+
+typedef struct csd_index_block
+{
+    uint64_t whitespace;
+    uint64_t structural;
+    uint64_t quote;
+    uint64_t backslash;
+} csd_index_block;
+
+typedef struct csd_index
+{
+    csd_index_block *blocks;
+    size_t size;
+    size_t count;
+    size_t first;
+    const char *source;
+} csd_index;
+
+#define csd_tape_escaped 0x80
+
+typedef struct csd_tape
+{
+    uint8_t *types;
+    uint32_t *offsets;
+    uint32_t *sizes;
+    uint32_t *hashes;
+    size_t count;
+    size_t capacity;
+    const csd_allocator *allocator;
+} csd_tape;
+
+/* parse time state, owned by whatever runs the parse, a lazy document keeps it alive */
+typedef struct csd_scanner
+{
+    csd_index index;
+    csd_tape tape;
+    size_t tape_at;
+    csd_token queued_token;
+    bool has_queued_token;
+} csd_scanner;
+
 typedef struct csd_nil
 {
 } csd_nil;
 
+typedef struct csd_string
+{
+    const char *data;
+    size_t size;
+    bool escaped;
+} csd_string;
+
 typedef struct csd_value *csd_array;
-typedef struct csd_node *csd_node_array;
 typedef struct csd_bucket
 {
     const char *key;
+    uint32_t hash;
     struct csd_node *value;
 } csd_bucket;
 typedef csd_bucket *csd_sequence;
 
+/*
+ * a value is its payload, a 32-bit string size and the tag bytes: 16 bytes. a longer
+ * string fails the parse. csd_wide_values keeps 64-bit sizes in 24-byte values.
+ */
+#ifdef csd_wide_values
+typedef size_t csd_value_size;
+#define csd_value_string_max SIZE_MAX
+#else
+typedef uint32_t csd_value_size;
+#define csd_value_string_max UINT32_MAX
+#endif
+
 typedef struct csd_value
 {
-    csd_type type;
     union {
         csd_nil as_nil;
         csd_array as_array;
@@ -127,43 +244,249 @@ typedef struct csd_value
         double as_float;
         int64_t as_int;
         bool as_boolean;
-        const char *as_string;
+        const char *_string;
     };
+    csd_value_size _string_size;
+    uint8_t type;
+    bool _escaped;
+    uint8_t _inline;
 } csd_value;
 
+/* short strings are copied in the payload and the size, _inline is their size plus one */
+#define csd_inline_escaped 0x80
+#define csd_inline_string_max offsetof(csd_value, type)
+#define csd_inline_string(v) ((char *)(v))
+#define csd_vstring_n(v, n) \
+    ((csd_value){._string = v, ._string_size = n, .type = csd_type_string})
+
+/*
+ * strings are read and written through these. the data of a short string is in v itself,
+ * it lives as long as v: a copy from csd_array_at, csd_lazy_value or on_value has to be
+ * kept while its string is used.
+ */
+static inline csd_string csd_raw_string(const csd_value *v)
+{
+    if (v->_inline) {
+        size_t size = (v->_inline & ~csd_inline_escaped) - 1u;
+        bool escaped = v->_inline & csd_inline_escaped;
+        return (csd_string){csd_inline_string((csd_value *)v), size, escaped};
+    }
+    return (csd_string){v->_string, v->_string_size, v->_escaped};
+}
+
+static inline void csd_set_string(csd_value *v, csd_string s)
+{
+    if (s.size <= csd_inline_string_max) {
+        if (s.size)
+            memmove(csd_inline_string(v), s.data, s.size);
+        v->_inline = (uint8_t)(s.size + 1) | (s.escaped ? csd_inline_escaped : 0);
+        return;
+    }
+    v->_inline = 0;
+    v->_string = s.data;
+    v->_string_size = (csd_value_size)s.size;
+    v->_escaped = s.escaped;
+}
+
 #define csd_vnil ((csd_value){.type = csd_type_nil, .as_nil = (csd_nil){}})
 #define csd_varray(v) ((csd_value){.type = csd_type_array, .as_array = v})
 #define csd_vsequence(v) ((csd_value){.type = csd_type_sequence, .as_sequence = v})
 #define csd_vfloat(v) ((csd_value){.type = csd_type_float, .as_float = v})
 #define csd_vint(v) ((csd_value){.type = csd_type_int, .as_int = v})
 #define csd_vboolean(v) ((csd_value){.type = csd_type_boolean, .as_boolean = v})
-#define csd_vstring(v) ((csd_value){.type = csd_type_string, .as_string = v})
+#define csd_vstring(v) csd_vstring_n(v, strlen(v))
 #define csd_vend() ((csd_value){.type = csd_type_end})
 
+typedef enum csd_source_kind
+{
+    csd_source_owned = 0,
+    csd_source_borrowed,
+    csd_source_mapped,
+} csd_source_kind;
+
 typedef struct csd_node
 {
     const char *key;
     csd_value value;
 } csd_node;
 
+typedef struct csd_arena_chunk csd_arena_chunk;
+
+/* a document owns its nodes, containers and strings, they are released all at once */
+typedef struct csd_arena
+{
+    csd_arena_chunk *chunks;
+    char *at;
+    char *end;
+    struct csd_arena *next;
+    const csd_allocator *allocator;
+
+    /* elements of the containers being parsed, copied out once complete */
+    csd_value *items;
+    csd_bucket *buckets;
+} csd_arena;
+
 typedef struct csd_document
 {
     char *source;
+    size_t size;
     csd_node *head;
-    csd_node_array nodes;
+    /* set before the first allocation, it must outlive the document */
+    const csd_allocator *allocator;
 
-    char *_strbuf;
+    csd_arena *_arena;
     char *_stream;
-    int _line;
-    int _column;
+    csd_source_kind _source_kind;
+    int _origin_line;
+    int _origin_column;
+    csd_scanner *_scanner;
+    size_t _depth;
+    size_t _max_depth;
+    bool _packed_arrays;
+
+    /* the reason is only allocated once a parse failed, it is NULL if that failed too */
+    csd_error error;
+    char *reason;
+} csd_document;
 
-    csd_token _queued_token;
-    bool _has_queued_token;
+typedef struct csd_pool csd_pool;
+
+/* a max_depth of 0 keeps csd_default_max_depth, an owned source is from the allocator */
+typedef struct csd_parse_options
+{
+    bool tape;
+    int threads;
+    /*
+     * a parallel parse runs on the pool threads, one chunk per thread. without a pool it
+     * splits into threads chunks, run on a pool shared by the process and started once.
+     * sources under csd_parallel_min_size are parsed sequentially.
+     */
+    csd_pool *pool;
+    size_t max_depth;
+    const csd_allocator *allocator;
+    /* arrays of only ints or only floats are stored unboxed, see csd_array_at */
+    bool packed_arrays;
+} csd_parse_options;
+
+static const csd_parse_options csd_parse_standard = (csd_parse_options){
+    .tape = false,
+    .threads = 1,
+    .max_depth = csd_default_max_depth,
+};
+
+static const csd_parse_options csd_parse_tape = (csd_parse_options){
+    .tape = true,
+    .threads = 1,
+    .max_depth = csd_default_max_depth,
+};
+
+typedef struct csd_input
+{
+    const char *source;
+    size_t size;
+} csd_input;
+
+/*
+ * documents need no initialization. without reuse each one is freed with csd_free, with
+ * reuse the next call recycles the previous one, the last call frees it.
+ */
+typedef struct csd_stream
+{
+    char *source;
+    size_t size;
+    size_t at;
+    bool reuse;
+    /* documents, the loaded source and the reason come from it */
+    const csd_allocator *allocator;
+
+    csd_source_kind _source_kind;
+    csd_scanner _scanner;
+    bool _has_document;
 
     csd_error error;
-    char reason[csd_reason_size];
-    jmp_buf _throw_env;
-} csd_document;
+    char *reason;
+} csd_stream;
+
+typedef enum csd_parser_state
+{
+    csd_parser_document,
+    csd_parser_sequence_first,
+    csd_parser_sequence_next,
+    csd_parser_sequence_separator,
+    csd_parser_key,
+    csd_parser_value,
+    csd_parser_array_first,
+    csd_parser_array_next,
+    csd_parser_array_separator,
+    csd_parser_done,
+} csd_parser_state;
+
+typedef struct csd_parser_frame
+{
+    csd_node *node;
+    csd_value value;
+    uint32_t hash;
+} csd_parser_frame;
+
+typedef struct csd_parser
+{
+    csd_document doc;
+    char *buffer;
+    size_t retry_size;
+    csd_parser_frame *stack;
+    csd_parser_state state;
+    const char *key;
+    uint32_t hash;
+    bool after_sequence;
+    csd_scanner _scanner;
+    /* consumed bytes left before the buffer start to keep it block aligned */
+    size_t _consumed;
+    /* whole blocks of the buffer classified by the last scan */
+    size_t _indexed;
+} csd_parser;
+
+typedef struct csd_lazy
+{
+    csd_document *doc;
+    size_t offset;
+    csd_type type;
+    bool ok;
+    /* the container of an element reached by csd_lazy_first or csd_lazy_next */
+    csd_type _parent;
+} csd_lazy;
+
+typedef enum csd_cursor_kind
+{
+    csd_cursor_document,
+    csd_cursor_sequence,
+    csd_cursor_array,
+} csd_cursor_kind;
+
+typedef struct csd_cursor_frame
+{
+    csd_cursor_kind kind;
+    bool first;
+    bool after_sequence;
+} csd_cursor_frame;
+
+typedef struct csd_cursor
+{
+    csd_document doc;
+    csd_cursor_frame *stack;
+    const char *key;
+    csd_scanner _scanner;
+} csd_cursor;
+
+typedef struct csd_handler
+{
+    void (*on_key)(void *user, const char *key, size_t size);
+    void (*on_value)(void *user, csd_value value);
+    void (*on_sequence_begin)(void *user);
+    void (*on_sequence_end)(void *user);
+    void (*on_array_begin)(void *user);
+    void (*on_array_end)(void *user);
+    void (*on_error)(void *user, csd_error error, const char *reason);
+} csd_handler;
 
 typedef struct csd_write_format
 {
@@ -209,6 +532,7 @@ struct csd_write_device
     char *string;
     csd_write_format format;
     csd_error status;
+    const csd_allocator *allocator;
 };
 
 typedef struct csd_write_string_backend
@@ -225,6 +549,11 @@ typedef struct csd_write_malloc_backend
     size_t capacity;
 } csd_write_malloc_backend;
 
+/*
+ * nodes live in the document arena, containers given to them are moved there. out of
+ * memory, or given a string over csd_value_string_max, they are null and the document
+ * has failed.
+ */
 csd_node *csd_new_nil(csd_document *doc, const char *name);
 csd_node *csd_new_array(csd_document *doc, const char *name, csd_array v);
 csd_node *csd_new_sequence(csd_document *doc, const char *name, csd_sequence v);
@@ -233,10 +562,15 @@ csd_node *csd_new_int(csd_document *doc, const char *name, int64_t v);
 csd_node *csd_new_boolean(csd_document *doc, const char *name, bool v);
 csd_node *csd_new_string(csd_document *doc, const char *name, const char *v);
 
+uint32_t csd_hash(const char *s, size_t size);
+/* pushes return null when out of memory, the container is left as it was */
 csd_node *csd_sequence_push(csd_sequence *sequence, csd_node *n);
+csd_node *csd_sequence_push_hashed(csd_sequence *sequence, csd_node *n, uint32_t hash);
 void csd_sequence_remove(csd_sequence *sequence, const char *key);
 csd_node *csd_sequence_get(csd_sequence *sequence, const char *key);
+csd_node *csd_sequence_get_hashed(csd_sequence *sequence, const char *key, uint32_t hash);
 size_t csd_sequence_count(csd_sequence *sequence);
+void csd_sequence_free(csd_sequence *sequence);
 
 #define csd_insert(node, n) csd_sequence_push(&(node)->value.as_sequence, n)
 #define csd_remove(node, key) csd_sequence_remove(&(node)->value.as_sequence, key)
@@ -245,7 +579,7 @@ size_t csd_sequence_count(csd_sequence *sequence);
 
 static const csd_node _csd_end_sentinel = (csd_node){
     .key = "_csd_end_sentinel",
-    .value = {csd_type_end},
+    .value = {.type = csd_type_end},
 };
 
 csd_node *csd_make_sequence_x(csd_document *doc, const char *name, ...);
@@ -257,24 +591,110 @@ typedef void (*csd_neq_cb)(csd_node *a, csd_node *b, void *);
 bool csd_eq_x(csd_node *a, csd_node *b, csd_neq_cb neq_cb, void *data);
 bool csd_eq(csd_node *a, csd_node *b);
 
+/* a packed array is unpacked by a push, its items are only read with csd_array_at */
 csd_value *csd_array_push(csd_array *array, csd_value v);
 size_t csd_array_len(csd_array *array);
+csd_value csd_array_at(csd_array *array, size_t i);
+/* the buffer of a packed array, or null for any other value */
+int64_t *csd_array_as_int64(csd_node *node, size_t *len);
+double *csd_array_as_double(csd_node *node, size_t *len);
 
 #define csd_push(node, v) csd_array_push(&(node)->value.as_array, v)
 #define csd_len(node) csd_array_len(&(node)->value.as_array)
 
+/* the data is in the value or the arena, the string lives as long as the node */
+csd_string csd_value_string(csd_document *doc, csd_value *value);
+bool csd_string_eq(csd_string a, csd_string b);
+size_t csd_unescape(char *out, const char *s, size_t size);
+
+#define csd_str(doc, node) csd_value_string(doc, &(node)->value)
+
+bool csd_int_from_chars(const char *s, size_t size, int64_t *v);
+bool csd_float_from_chars(const char *s, size_t size, double *v);
+
 void csd_free(csd_document *doc);
 void csd_free_node(csd_node *node);
 void csd_free_value(csd_value *value);
 
 csd_document csd_parse(char *source);
+csd_document csd_parse_x(char *source, csd_parse_options options);
+csd_document csd_parse_n(const char *source, size_t size, csd_parse_options options);
 csd_document csd_parse_stream(FILE *f);
+csd_document csd_parse_stream_x(FILE *f, csd_parse_options options);
+csd_document csd_parse_file(const char *path);
+csd_document csd_parse_file_x(const char *path, csd_parse_options options);
+
+/* out of memory the stream is opened with its error set, it yields no document */
+void csd_stream_open(csd_stream *s, const char *source, size_t size,
+                     const csd_allocator *allocator);
+csd_error csd_stream_open_file(csd_stream *s, const char *path,
+                               const csd_allocator *allocator);
+bool csd_stream_next(csd_stream *s, csd_document *doc);
+void csd_stream_close(csd_stream *s);
+
+/*
+ * a pool runs one job at a time. a parse or batch given a pool from one of its own jobs,
+ * such as an allocator called by a worker, fails with csd_pool_error instead of waiting
+ * on itself.
+ */
+csd_pool *csd_pool_new(int threads, const csd_allocator *allocator);
+void csd_pool_free(csd_pool *pool);
+int csd_pool_threads(csd_pool *pool);
+/* each document is parsed by a single worker, the threads and pool options are unused */
+size_t csd_parse_batch(const csd_input *inputs, size_t n, csd_document *out,
+                       csd_pool *pool, csd_parse_options options);
+
+/* doc.allocator can be set between csd_parser_init and the first feed */
+void csd_parser_init(csd_parser *p);
+csd_error csd_parser_feed(csd_parser *p, const char *chunk, size_t size);
+csd_document csd_parser_finish(csd_parser *p);
+
+csd_document csd_parse_select(const char *source, const char **paths, size_t n);
+
+csd_document csd_parse_lazy(const char *source, size_t size);
+csd_lazy csd_lazy_root(csd_document *doc);
+csd_lazy csd_lazy_at(csd_lazy v, const char *key);
+csd_lazy csd_lazy_index(csd_lazy v, size_t i);
+/* at and index walk the container from its start, first and next walk it once */
+csd_lazy csd_lazy_first(csd_lazy v);
+csd_lazy csd_lazy_next(csd_lazy element);
+size_t csd_lazy_len(csd_lazy v);
+csd_value csd_lazy_value(csd_lazy v);
+
+csd_error csd_cursor_open(csd_cursor *c, const char *source, size_t size);
+csd_node *csd_cursor_next_value(csd_cursor *c);
+bool csd_cursor_skip(csd_cursor *c);
+bool csd_cursor_enter(csd_cursor *c);
+void csd_cursor_close(csd_cursor *c);
+
+csd_error csd_parse_events(const char *source, const csd_handler *h, void *user);
+csd_error csd_parse_events_n(const char *source, size_t size, const csd_handler *h,
+                             void *user);
+
+/* false when the blocks cannot be allocated */
+bool csd_index_build(csd_index *index, const char *source, size_t size);
+bool csd_index_extend(csd_index *index, const char *source, size_t size, size_t block);
+bool csd_index_reserve(csd_index *index, size_t size);
+void csd_index_fill(csd_index *index, const char *source, size_t from, size_t to);
+bool csd_index_window(csd_index *index, const char *source, size_t size);
+void csd_index_free(csd_index *index);
+csd_index_class csd_index_classof(char c);
+uint64_t csd_index_mask(csd_index *index, size_t block, csd_index_class classes);
+size_t csd_index_next(csd_index *index, size_t at, csd_index_class classes);
+size_t csd_index_skip(csd_index *index, size_t at, csd_index_class classes);
+
+void csd_tape_build(csd_document *doc);
+void csd_tape_free(csd_tape *tape);
+csd_token csd_tape_token(const csd_document *doc, size_t i);
 
 void csd_write_x(csd_write_device *dev, csd_node *node, int depth);
 csd_write_device csd_write_stream(FILE *f, csd_node *node, csd_write_format format);
 csd_write_device csd_write_string(char *buf, size_t size, csd_node *node,
                                   csd_write_format format);
 csd_write_device csd_write_malloc(csd_node *node, csd_write_format format);
+/* the string is released with the allocator */
+csd_write_device csd_write_malloc_x(csd_node *node, csd_write_format format,
+                                    const csd_allocator *allocator);
 
 void csd_stream_writer(csd_write_device *dev, const char *format, ...)
     csd_printf_like(2, 3);
@@ -283,12 +703,16 @@ void csd_string_writer(csd_write_device *dev, const char *format, ...)
 void csd_malloc_writer(csd_write_device *dev, const char *format, ...)
     csd_printf_like(2, 3);
 
-void csd_throw(csd_document *doc) csd_noreturn;
-void csd_scan_throw(csd_document *doc, csd_token token, const char *format,
-                    ...) csd_noreturn;
-void csd_parse_throw(csd_document *doc, csd_token token, const char *format,
-                     ...) csd_noreturn;
-void csd_file_throw(csd_document *doc, const char *filepath, const char *format,
-                    ...) csd_noreturn;
+void csd_source_position(csd_document *doc, size_t offset, int *line, int *column);
+void csd_fail(csd_document *doc, csd_error error, const char *format, ...)
+    csd_printf_like(3, 4);
+csd_token csd_scan_fail(csd_document *doc, csd_token token, const char *format, ...)
+    csd_printf_like(3, 4);
+void csd_parse_fail(csd_document *doc, csd_token token, const char *format, ...)
+    csd_printf_like(3, 4);
+void csd_file_fail(csd_document *doc, const char *filepath, const char *format, ...)
+    csd_printf_like(3, 4);
+void csd_memory_fail(csd_document *doc);
+csd_token csd_expect_fail(csd_document *doc, csd_token token, csd_token_mask mask);
 
 #endif
@@ -0,0 +1,88 @@
+#include "csd.h"
+#include "csd_ds.h"
+#include <stdlib.h>
+
+/* a null allocator is the C library one */
+void *csd_mem_alloc(const csd_allocator *a, size_t size)
+{
+    return a ? a->alloc(a->user, size) : malloc(size);
+}
+
+void *csd_mem_realloc(const csd_allocator *a, void *p, size_t size)
+{
+    return a ? a->realloc(a->user, p, size) : realloc(p, size);
+}
+
+void csd_mem_free(const csd_allocator *a, void *p)
+{
+    if (!p)
+        return;
+    if (a)
+        a->free(a->user, p);
+    else
+        free(p);
+}
+
+/* stb_ds blocks record their allocator, they can be freed from anywhere */
+typedef struct csd_ds_prefix
+{
+    const csd_allocator *allocator;
+    size_t padding;
+} csd_ds_prefix;
+
+static _Thread_local const csd_allocator *csd_ds_allocator;
+
+/* new stb_ds blocks of this thread come from a, the previous allocator is returned */
+const csd_allocator *csd_ds_use(const csd_allocator *a)
+{
+    const csd_allocator *previous = csd_ds_allocator;
+    csd_ds_allocator = a;
+    return previous;
+}
+
+void *csd_ds_realloc(void *p, size_t size)
+{
+    csd_ds_prefix *prefix = p ? (csd_ds_prefix *)p - 1 : NULL;
+    const csd_allocator *a = prefix ? prefix->allocator : csd_ds_allocator;
+
+    prefix = csd_mem_realloc(a, prefix, sizeof(csd_ds_prefix) + size);
+    /* stb_ds writes through the result, arrays grown without a reserve cannot recover */
+    if (!prefix)
+        abort();
+    prefix->allocator = a;
+    return prefix + 1;
+}
+
+/* room for capacity elements, doubled like stb_ds does, the array is kept on failure */
+bool csd_ds_grow(void **a, size_t element_size, size_t capacity)
+{
+    stbds_array_header *header = *a ? stbds_header(*a) : NULL;
+    size_t current = header ? header->capacity : 0;
+    if (capacity <= current)
+        return true;
+    capacity = capacity < 2 * current ? 2 * current : capacity;
+    capacity = capacity < 4 ? 4 : capacity;
+
+    csd_ds_prefix *prefix = header ? (csd_ds_prefix *)header - 1 : NULL;
+    const csd_allocator *allocator = prefix ? prefix->allocator : csd_ds_allocator;
+    prefix = csd_mem_realloc(allocator, prefix,
+                             sizeof(csd_ds_prefix) + sizeof(stbds_array_header) +
+                                 capacity * element_size);
+    if (!prefix)
+        return false;
+    prefix->allocator = allocator;
+    header = (stbds_array_header *)(prefix + 1);
+    if (!*a)
+        *header = (stbds_array_header){0};
+    header->capacity = capacity;
+    *a = header + 1;
+    return true;
+}
+
+void csd_ds_free(void *p)
+{
+    if (!p)
+        return;
+    csd_ds_prefix *prefix = (csd_ds_prefix *)p - 1;
+    csd_mem_free(prefix->allocator, prefix);
+}
@@ -0,0 +1,139 @@
+#include "csd.h"
+#include "csd_ds.h"
+#include <stdlib.h>
+
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+void csd_arena_free(csd_arena **arena);
+
+struct csd_arena_chunk
+{
+    csd_arena_chunk *next;
+    size_t size;
+};
+
+#define csd_arena_align(size) (((size) + 7) & ~(size_t)7)
+#define csd_arena_data(chunk) ((char *)((chunk) + 1))
+
+static bool csd_arena_grow(csd_arena *arena, size_t size)
+{
+    /* chunks double up to a cap, a larger allocation gets a chunk of its own */
+    size_t chunk_size = arena->chunks ? 2 * arena->chunks->size : csd_arena_chunk_min;
+    chunk_size = chunk_size > csd_arena_chunk_max ? csd_arena_chunk_max : chunk_size;
+    chunk_size = chunk_size < size ? size : chunk_size;
+
+    csd_arena_chunk *chunk =
+        csd_mem_alloc(arena->allocator, sizeof(csd_arena_chunk) + chunk_size);
+    if (!chunk)
+        return false;
+    chunk->next = arena->chunks;
+    chunk->size = chunk_size;
+    arena->chunks = chunk;
+    arena->at = csd_arena_data(chunk);
+    arena->end = arena->at + chunk_size;
+    return true;
+}
+
+csd_arena *csd_arena_new(const csd_allocator *allocator)
+{
+    csd_arena *arena = csd_mem_alloc(allocator, sizeof(csd_arena));
+    if (!arena)
+        return NULL;
+    *arena = (csd_arena){0};
+    arena->allocator = allocator;
+    return arena;
+}
+
+/* null when the allocator fails, the arena is left as it was */
+void *csd_arena_alloc(csd_arena *arena, size_t size)
+{
+    size = csd_arena_align(size);
+    if ((size_t)(arena->end - arena->at) < size && !csd_arena_grow(arena, size))
+        return NULL;
+
+    void *p = arena->at;
+    arena->at += size;
+    return p;
+}
+
+/* arenas of parallel chunks are chained to the document, their nodes never move */
+void csd_arena_chain(csd_arena *arena, csd_arena *from)
+{
+    if (!from)
+        return;
+
+    csd_arena *last = from;
+    while (last->next)
+        last = last->next;
+    last->next = arena->next;
+    arena->next = from;
+}
+
+/* bytes handed out, the tail of the current chunks is not counted */
+size_t csd_arena_used(csd_arena *arena)
+{
+    size_t used = 0;
+    for (; arena; arena = arena->next) {
+        for (csd_arena_chunk *chunk = arena->chunks; chunk; chunk = chunk->next)
+            used += chunk->size;
+        if (arena->chunks)
+            used -= arena->end - arena->at;
+    }
+    return used;
+}
+
+static void csd_arena_free_chunks(const csd_allocator *allocator, csd_arena_chunk *chunk)
+{
+    while (chunk) {
+        csd_arena_chunk *next = chunk->next;
+        csd_mem_free(allocator, chunk);
+        chunk = next;
+    }
+}
+
+/* keeps the largest chunk for the next document, the most recent one may be smaller */
+void csd_arena_reset(csd_arena *arena)
+{
+    if (!arena)
+        return;
+
+    csd_arena *chained = arena->next;
+    arena->next = NULL;
+    while (chained) {
+        csd_arena *next = chained->next;
+        chained->next = NULL;
+        csd_arena_free(&chained);
+        chained = next;
+    }
+
+    csd_arena_chunk *largest = arena->chunks;
+    for (csd_arena_chunk *chunk = arena->chunks; chunk; chunk = chunk->next)
+        largest = chunk->size > largest->size ? chunk : largest;
+    if (largest) {
+        csd_arena_chunk **link = &arena->chunks;
+        while (*link != largest)
+            link = &(*link)->next;
+        *link = largest->next;
+        csd_arena_free_chunks(arena->allocator, arena->chunks);
+        largest->next = NULL;
+        arena->chunks = largest;
+        arena->at = csd_arena_data(largest);
+        arena->end = arena->at + largest->size;
+    }
+    arrsetlen(arena->items, 0);
+    arrsetlen(arena->buckets, 0);
+}
+
+void csd_arena_free(csd_arena **arena)
+{
+    csd_arena *a = *arena;
+    while (a) {
+        csd_arena *next = a->next;
+        csd_arena_free_chunks(a->allocator, a->chunks);
+        arrfree(a->items);
+        arrfree(a->buckets);
+        csd_mem_free(a->allocator, a);
+        a = next;
+    }
+    *arena = NULL;
+}
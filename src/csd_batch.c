@@ -0,0 +1,314 @@
+#include "csd.h"
+#include "csd_ds.h"
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h>
+#define csd_has_threads
+#endif
+
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_node *csd_parse_node(csd_document *doc, uint32_t *hash);
+csd_arena *csd_arena_new(const csd_allocator *allocator);
+void csd_arena_reset(csd_arena *arena);
+void csd_arena_free(csd_arena **arena);
+
+typedef struct csd_pool_worker csd_pool_worker;
+typedef void (*csd_pool_fn)(void *arg, csd_pool_worker *worker);
+
+typedef struct csd_batch
+{
+    const csd_input *inputs;
+    csd_document *out;
+    size_t n;
+    csd_parse_options options;
+    size_t next;
+    size_t failed;
+} csd_batch;
+
+/* scratch kept by a worker from one document to the next */
+struct csd_pool_worker
+{
+    csd_pool *pool;
+    csd_scanner scanner;
+    csd_arena *spare;
+    csd_value *items;
+    csd_bucket *buckets;
+};
+
+struct csd_pool
+{
+    csd_pool_worker workers[csd_parallel_max_threads];
+    int count;
+    const csd_allocator *allocator;
+#ifdef csd_has_threads
+    pthread_t threads[csd_parallel_max_threads];
+    pthread_mutex_t submit;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    csd_pool_fn fn;
+    void *arg;
+    size_t generation;
+    int busy;
+    bool stop;
+#endif
+};
+
+/* the pool whose job this thread runs, a job submitting to it again would wait forever */
+static _Thread_local csd_pool *csd_pool_current;
+
+bool csd_pool_nested(csd_pool *pool)
+{
+    return pool && csd_pool_current == pool;
+}
+
+static void csd_pool_worker_free(csd_pool_worker *worker)
+{
+    csd_index_free(&worker->scanner.index);
+    csd_arena_free(&worker->spare);
+    arrfree(worker->items);
+    arrfree(worker->buckets);
+}
+
+/*
+ * the index blocks and arena scratch of the previous document are reused. the arena of
+ * a document without nodes is rewound and kept for the next one.
+ */
+static void csd_batch_parse(csd_pool_worker *worker, const csd_parse_options *options,
+                            const csd_input *input, csd_document *doc)
+{
+    csd_scanner *scanner = &worker->scanner;
+    *doc = (csd_document){0};
+    doc->source = (char *)input->source;
+    doc->size = input->size;
+    doc->allocator = options->allocator;
+    doc->_stream = doc->source;
+    doc->_source_kind = csd_source_borrowed;
+    doc->_scanner = scanner;
+    doc->_max_depth = options->max_depth;
+    doc->_packed_arrays = options->packed_arrays;
+    scanner->has_queued_token = false;
+    scanner->tape_at = 0;
+
+    csd_arena *arena = worker->spare;
+    worker->spare = NULL;
+    if (arena && arena->allocator != doc->allocator)
+        csd_arena_free(&arena);
+    doc->_arena = arena ? arena : csd_arena_new(doc->allocator);
+    if (!doc->_arena || !csd_index_window(&scanner->index, doc->source, doc->size)) {
+        csd_memory_fail(doc);
+        csd_arena_free(&doc->_arena);
+        doc->_scanner = NULL;
+        return;
+    }
+    doc->_arena->items = worker->items;
+    doc->_arena->buckets = worker->buckets;
+
+    /* tape offsets are 32-bit, larger sources are scanned lazily */
+    if (options->tape && doc->size <= UINT32_MAX)
+        csd_tape_build(doc);
+    if (!csd_read(doc, csd_token_eof).ok)
+        doc->head = csd_parse_node(doc, NULL);
+
+    worker->items = doc->_arena->items;
+    worker->buckets = doc->_arena->buckets;
+    doc->_arena->items = NULL;
+    doc->_arena->buckets = NULL;
+    if (doc->error != csd_ok || !doc->head) {
+        csd_arena_reset(doc->_arena);
+        worker->spare = doc->_arena;
+        doc->_arena = NULL;
+        doc->head = NULL;
+    }
+    csd_tape_free(&scanner->tape);
+    doc->_scanner = NULL;
+}
+
+/* workers take the next document until the batch runs out, small ones balance out */
+static void csd_batch_run(void *arg, csd_pool_worker *worker)
+{
+    csd_batch *batch = arg;
+    size_t failed = 0;
+    const csd_allocator *previous = csd_ds_use(batch->options.allocator);
+
+    while (1) {
+        size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (i >= batch->n)
+            break;
+        csd_batch_parse(worker, &batch->options, &batch->inputs[i], &batch->out[i]);
+        failed += batch->out[i].error != csd_ok;
+    }
+    csd_ds_use(previous);
+    __atomic_fetch_add(&batch->failed, failed, __ATOMIC_RELAXED);
+}
+
+#ifdef csd_has_threads
+static void *csd_pool_main(void *p)
+{
+    csd_pool_worker *worker = p;
+    csd_pool *pool = worker->pool;
+    size_t generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stop && pool->generation == generation)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->stop)
+            break;
+        generation = pool->generation;
+        csd_pool_fn fn = pool->fn;
+        void *arg = pool->arg;
+
+        pthread_mutex_unlock(&pool->lock);
+        csd_pool_current = pool;
+        fn(arg, worker);
+        csd_pool_current = NULL;
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+#endif
+
+csd_pool *csd_pool_new(int threads, const csd_allocator *allocator)
+{
+    csd_pool *pool = csd_mem_alloc(allocator, sizeof(csd_pool));
+    if (!pool)
+        return NULL;
+    *pool = (csd_pool){.allocator = allocator};
+    threads = threads < 1 ? 1 : threads;
+    threads = threads > csd_parallel_max_threads ? csd_parallel_max_threads : threads;
+    pool->workers[0].pool = pool;
+    pool->count = 1;
+
+#ifdef csd_has_threads
+    pthread_mutex_init(&pool->submit, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    /* the submitting thread is the first worker, a pool of one starts no thread */
+    for (int k = 1; k < threads; k++) {
+        pool->workers[k].pool = pool;
+        if (pthread_create(&pool->threads[k], NULL, csd_pool_main, &pool->workers[k]))
+            break;
+        pool->count++;
+    }
+#endif
+    return pool;
+}
+
+void csd_pool_free(csd_pool *pool)
+{
+    if (!pool)
+        return;
+
+#ifdef csd_has_threads
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int k = 1; k < pool->count; k++)
+        pthread_join(pool->threads[k], NULL);
+
+    pthread_mutex_destroy(&pool->submit);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+#endif
+    for (int k = 0; k < pool->count; k++)
+        csd_pool_worker_free(&pool->workers[k]);
+    csd_mem_free(pool->allocator, pool);
+}
+
+int csd_pool_threads(csd_pool *pool)
+{
+    return pool ? pool->count : 1;
+}
+
+#ifdef csd_has_threads
+static pthread_once_t csd_pool_shared_once = PTHREAD_ONCE_INIT;
+#endif
+static csd_pool *csd_pool_shared_pool;
+
+static void csd_pool_shared_start(void)
+{
+#ifdef csd_has_threads
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    csd_pool_shared_pool = csd_pool_new(cpus > 0 ? (int)cpus : 1, NULL);
+#endif
+}
+
+/* one thread per cpu for parses given no pool, it lives as long as the process */
+csd_pool *csd_pool_shared(void)
+{
+#ifdef csd_has_threads
+    pthread_once(&csd_pool_shared_once, csd_pool_shared_start);
+#endif
+    return csd_pool_shared_pool;
+}
+
+/* every worker runs fn once, the calling thread too, one job runs at a time */
+void csd_pool_run(csd_pool *pool, csd_pool_fn fn, void *arg)
+{
+#ifdef csd_has_threads
+    pthread_mutex_lock(&pool->submit);
+    if (pool->count > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->fn = fn;
+        pool->arg = arg;
+        pool->busy = pool->count - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+#endif
+
+    csd_pool *previous = csd_pool_current;
+    csd_pool_current = pool;
+    fn(arg, &pool->workers[0]);
+    csd_pool_current = previous;
+
+#ifdef csd_has_threads
+    if (pool->count > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->busy)
+            pthread_cond_wait(&pool->done, &pool->lock);
+        pool->fn = NULL;
+        pool->arg = NULL;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->submit);
+#endif
+}
+
+size_t csd_parse_batch(const csd_input *inputs, size_t n, csd_document *out,
+                       csd_pool *pool, csd_parse_options options)
+{
+    csd_batch batch = {inputs, out, n, options, 0, 0};
+
+    if (csd_pool_nested(pool)) {
+        const char *reason = "batch submitted from a job of its own pool";
+        for (size_t i = 0; i < n; i++) {
+            out[i] = (csd_document){.allocator = options.allocator};
+            csd_fail(&out[i], csd_pool_error, reason);
+        }
+        return n;
+    }
+    if (!pool) {
+        csd_pool_worker worker = {0};
+        csd_batch_run(&batch, &worker);
+        csd_pool_worker_free(&worker);
+        return batch.failed;
+    }
+
+    csd_pool_run(pool, csd_batch_run, &batch);
+    return batch.failed;
+}
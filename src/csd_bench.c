@@ -0,0 +1,820 @@
+#include "csd.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct csd_bench
+{
+    const char *name;
+    void (*run)(void);
+} csd_bench;
+
+typedef csd_token (*csd_bench_scanner)(csd_document *doc);
+
+csd_token csd_scan_token(csd_document *doc);
+csd_token csd_eat_keyword(csd_document *doc, csd_keyword keyword);
+csd_token csd_eat_id(csd_document *doc);
+csd_token csd_eat_number(csd_document *doc);
+csd_token csd_eat_dumb(csd_document *doc);
+void csd_eat_to(csd_document *doc, char *end);
+size_t csd_arena_used(csd_arena *arena);
+
+#define csd_bench_source_size (16 << 20)
+#define csd_bench_runs 5
+
+double csd_bench_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+char *csd_bench_source(const char *unit, size_t size, size_t *length)
+{
+    size_t unit_size = strlen(unit);
+    size_t count = size / unit_size;
+    char *source = malloc(count * unit_size + 16);
+    char *it = source;
+
+    it += sprintf(it, "{\n");
+    for (size_t i = 0; i < count; i++) {
+        memcpy(it, unit, unit_size);
+        it += unit_size;
+    }
+    it += sprintf(it, "end: 0\n}");
+
+    *length = it - source;
+    return source;
+}
+
+void csd_bench_check(csd_document *doc)
+{
+    if (doc->error != csd_ok) {
+        fprintf(stderr, "bench scan failed: %s\n", doc->reason);
+        exit(1);
+    }
+}
+
+void csd_bench_report(const char *name, double seconds, size_t items, const char *unit,
+                      size_t bytes)
+{
+    printf("  %-28s %8.2f M%s/s %8.1f MB/s\n", name, items / seconds / 1e6, unit,
+           bytes / seconds / 1e6);
+}
+
+csd_token csd_bench_legacy_scan_token(csd_document *doc)
+{
+    static const csd_keyword keywords[] = {
+        {"'", csd_token_string, 1},    {"\"", csd_token_string, 1},
+        {",", csd_token_comma, 1},     {"{", csd_token_scope_begin, 1},
+        {"}", csd_token_scope_end, 1}, {"[", csd_token_array_begin, 1},
+        {"]", csd_token_array_end, 1}, {":", csd_token_assign, 1},
+        {"#", csd_token_comment, 1},   {"true", csd_token_true, 4},
+        {"false", csd_token_false, 5},
+    };
+
+    size_t at = csd_index_skip(&doc->_scanner->index, doc->_stream - doc->source,
+                               csd_index_whitespace);
+    csd_eat_to(doc, &doc->source[at]);
+    if (at >= doc->size)
+        return (csd_token){.type = csd_token_eof};
+
+    for (size_t i = 0; i < csd_array_sizeof(keywords); i++) {
+        if (strncmp(keywords[i].word, doc->_stream, strlen(keywords[i].word)) == 0)
+            return csd_eat_keyword(doc, keywords[i]);
+    }
+    if (isalpha(*doc->_stream) || *doc->_stream == '_')
+        return csd_eat_id(doc);
+    if (*doc->_stream == '-' || *doc->_stream == '+' || isdigit(*doc->_stream))
+        return csd_eat_number(doc);
+
+    return csd_scan_fail(doc, csd_eat_dumb(doc), "unknown token encountered");
+}
+
+double csd_bench_scan_x(csd_bench_scanner scanner, const char *pristine, size_t size,
+                        size_t *tokens, double *indexing, bool borrowed)
+{
+    char *source = malloc(size + 1);
+    double best = 1e30;
+    *indexing = 1e30;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        memcpy(source, pristine, size + 1);
+        csd_document doc = {0};
+        csd_scanner state = {0};
+        doc.source = source;
+        doc.size = size;
+        doc._stream = source;
+        doc._scanner = &state;
+        doc._source_kind = borrowed ? csd_source_borrowed : csd_source_owned;
+
+        double start = csd_bench_now();
+        csd_index_build(&state.index, doc.source, doc.size);
+        double indexed = csd_bench_now();
+        *tokens = 0;
+        while (scanner(&doc).type != csd_token_eof)
+            (*tokens)++;
+        double end = csd_bench_now();
+        csd_bench_check(&doc);
+
+        best = end - indexed < best ? end - indexed : best;
+        *indexing = indexed - start < *indexing ? indexed - start : *indexing;
+        csd_index_free(&state.index);
+    }
+
+    free(source);
+    return best;
+}
+
+double csd_bench_scan(csd_bench_scanner scanner, const char *pristine, size_t size,
+                      size_t *tokens, double *indexing)
+{
+    return csd_bench_scan_x(scanner, pristine, size, tokens, indexing, false);
+}
+
+void csd_bench_token_rate(void)
+{
+    const char *unit = "  width: 1920, height: -1080, visible: true, hidden: false,\n"
+                       "  title: 'Tetris game', name: \"player\", # comment\n"
+                       "  colors: [128, 128, 0x80], tags: ['a', 'b'], flags: 0b101,\n";
+    size_t size;
+    char *source = csd_bench_source(unit, csd_bench_source_size, &size);
+    size_t tokens;
+    double indexing;
+
+    double legacy =
+        csd_bench_scan(&csd_bench_legacy_scan_token, source, size, &tokens, &indexing);
+    csd_bench_report("linear keyword scan", legacy, tokens, "tok", size);
+    double dispatch = csd_bench_scan(&csd_scan_token, source, size, &tokens, &indexing);
+    csd_bench_report("first-byte dispatch", dispatch, tokens, "tok", size);
+    csd_bench_report("structural index", indexing, size, "B", size);
+    printf("  speedup: %.2fx\n", legacy / dispatch);
+
+    free(source);
+}
+
+char *csd_bench_escaped_source(int density, size_t size, size_t *length)
+{
+    const char *plain = "abcdefghijklmnopqrstuvwxyz0123456789";
+    const char *escapes[] = {"\\\\", "\\n", "\\t", "\\\""};
+    char *source = malloc(size + 8192);
+    char *it = source;
+    unsigned seed = 1;
+
+    it += sprintf(it, "{\nstrings: [\n");
+    while ((size_t)(it - source) < size) {
+        *it++ = '\'';
+        for (int i = 0; i < 2048; i++) {
+            seed = seed * 1103515245 + 12345;
+            if ((int)((seed >> 16) % 100) < density)
+                it += sprintf(it, "%s", escapes[(seed >> 8) % 4]);
+            else
+                *it++ = plain[(seed >> 8) % 36];
+        }
+        it += sprintf(it, "',\n");
+    }
+    it += sprintf(it, "''\n]\n}");
+
+    *length = it - source;
+    return source;
+}
+
+size_t csd_bench_legacy_string(char *s)
+{
+    char *end = strchr(s, '\'');
+    size_t size = end - s;
+    char *seq = s;
+
+    while ((seq = memchr(seq, '\\', size - (seq - s))) != NULL) {
+        size_t index = seq - s;
+        seq[0] = csd_char_to_escape_sequence[(uint8_t)seq[1]];
+        memmove(seq + 1, seq + 2, size - index - 1);
+        size--;
+        seq++;
+    }
+    s[size] = '\0';
+    return end - s + 1;
+}
+
+double csd_bench_legacy_strings(const char *pristine, size_t size, size_t *strings)
+{
+    char *source = malloc(size + 1);
+    double best = 1e30;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        memcpy(source, pristine, size + 1);
+
+        double start = csd_bench_now();
+        char *it = source;
+        *strings = 0;
+        while ((it = strchr(it, '\'')) != NULL) {
+            it += 1 + csd_bench_legacy_string(it + 1);
+            (*strings)++;
+        }
+        double elapsed = csd_bench_now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    free(source);
+    return best;
+}
+
+void csd_bench_escape_density(void)
+{
+    const int densities[] = {0, 5, 25, 50};
+
+    for (size_t i = 0; i < csd_array_sizeof(densities); i++) {
+        size_t size;
+        char *source =
+            csd_bench_escaped_source(densities[i], csd_bench_source_size / 4, &size);
+        size_t strings;
+        size_t tokens;
+        double indexing;
+
+        printf(" %d%% escapes\n", densities[i]);
+        double legacy = csd_bench_legacy_strings(source, size, &strings);
+        csd_bench_report("memmove per escape", legacy, strings, "str", size);
+        double single = csd_bench_scan(&csd_scan_token, source, size, &tokens, &indexing);
+        csd_bench_report("single pass", single, strings, "str", size);
+        double borrowed =
+            csd_bench_scan_x(&csd_scan_token, source, size, &tokens, &indexing, true);
+        csd_bench_report("borrowed, decode on access", borrowed, strings, "str", size);
+        csd_bench_report("structural index", indexing, size, "B", size);
+        printf("  speedup: %.2fx\n", legacy / single);
+        free(source);
+    }
+}
+
+void csd_bench_numbers(void)
+{
+    const char *unit = "  [1920, -1080, 3.14159, 0.000123, 6.02214076e23, 0x7f,\n"
+                       "   128, 16776960, -2.5e-3, 12345.6789, 0b1011, 1.7976931348623157e308],\n";
+    size_t size;
+    char *source = csd_bench_source(unit, csd_bench_source_size, &size);
+    csd_token *numbers = malloc(size / 2 * sizeof(csd_token));
+    size_t count = 0;
+    volatile double sink = 0;
+
+    csd_document doc = {0};
+    csd_scanner state = {0};
+    doc.source = source;
+    doc.size = size;
+    doc._stream = source;
+    doc._scanner = &state;
+    csd_index_build(&state.index, doc.source, doc.size);
+    for (csd_token token; (token = csd_scan_token(&doc)).type != csd_token_eof;) {
+        if (token.type & (csd_token_float | csd_token_int | csd_token_int_hex |
+                          csd_token_int_binary))
+            numbers[count++] = token;
+    }
+    csd_bench_check(&doc);
+    csd_index_free(&state.index);
+
+    double legacy = 1e30;
+    double in_house = 1e30;
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        for (size_t i = 0; i < count; i++) {
+            const char *expr = numbers[i].expr;
+            if (numbers[i].type == csd_token_float)
+                sink += strtod(expr, NULL);
+            else if (numbers[i].type == csd_token_int_binary)
+                sink += strtol(expr + 2 + (*expr == '-'), NULL, 2);
+            else
+                sink += strtol(expr, NULL, 0);
+        }
+        double elapsed = csd_bench_now() - start;
+        legacy = elapsed < legacy ? elapsed : legacy;
+
+        start = csd_bench_now();
+        for (size_t i = 0; i < count; i++) {
+            double f;
+            int64_t n;
+            if (numbers[i].type == csd_token_float)
+                csd_float_from_chars(numbers[i].expr, numbers[i].size, &f), sink += f;
+            else
+                csd_int_from_chars(numbers[i].expr, numbers[i].size, &n), sink += n;
+        }
+        elapsed = csd_bench_now() - start;
+        in_house = elapsed < in_house ? elapsed : in_house;
+    }
+
+    csd_bench_report("strtod/strtol", legacy, count, "num", size);
+    csd_bench_report("from_chars", in_house, count, "num", size);
+    printf("  speedup: %.2fx\n", legacy / in_house);
+
+    free(numbers);
+    free(source);
+}
+
+char *csd_bench_records_source(size_t size, size_t *length)
+{
+    char *source = malloc(size + 512);
+    char *it = source;
+
+    it += sprintf(it, "{\n");
+    for (size_t i = 0; (size_t)(it - source) < size; i++) {
+        it += sprintf(it,
+                      "  record_%zu {\n"
+                      "    width: 1920, height: -1080, ratio: 1.5, visible: true,\n"
+                      "    title: 'Tetris game', colors: [128, 128, 0x80], # comment\n"
+                      "  },\n",
+                      i);
+    }
+    it += sprintf(it, "  end: 0\n}");
+
+    *length = it - source;
+    return source;
+}
+
+double csd_bench_parse(const char *pristine, size_t size, csd_parse_options options)
+{
+    double best = 1e30;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        char *source = malloc(size + 1);
+        memcpy(source, pristine, size + 1);
+
+        double start = csd_bench_now();
+        csd_document doc = csd_parse_x(source, options);
+        double elapsed = csd_bench_now() - start;
+
+        if (doc.error != csd_ok) {
+            fprintf(stderr, "bench parse failed: %s\n", doc.reason);
+            exit(1);
+        }
+        best = elapsed < best ? elapsed : best;
+        csd_free(&doc);
+    }
+    return best;
+}
+
+double csd_bench_tape_build(const char *pristine, size_t size, size_t *tokens)
+{
+    char *source = malloc(size + 1);
+    double best = 1e30;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        memcpy(source, pristine, size + 1);
+        csd_document doc = {0};
+        csd_scanner state = {0};
+        doc.source = source;
+        doc.size = size;
+        doc._stream = source;
+        doc._scanner = &state;
+
+        double start = csd_bench_now();
+        csd_index_build(&state.index, doc.source, doc.size);
+        csd_tape_build(&doc);
+        double elapsed = csd_bench_now() - start;
+        csd_bench_check(&doc);
+
+        best = elapsed < best ? elapsed : best;
+        *tokens = state.tape.count;
+        csd_tape_free(&state.tape);
+        csd_index_free(&state.index);
+    }
+
+    free(source);
+    return best;
+}
+
+void csd_bench_tape(void)
+{
+    size_t size;
+    char *source = csd_bench_records_source(csd_bench_source_size / 4, &size);
+    size_t tokens;
+
+    double lazy = csd_bench_parse(source, size, csd_parse_standard);
+    csd_bench_report("lazy scan parse", lazy, size, "B", size);
+    double taped = csd_bench_parse(source, size, csd_parse_tape);
+    csd_bench_report("tape parse", taped, size, "B", size);
+    double scan = csd_bench_tape_build(source, size, &tokens);
+    csd_bench_report("  scan to tape", scan, tokens, "tok", size);
+    csd_bench_report("  tree from tape", taped - scan, tokens, "tok", size);
+    printf("  tape: %zu tokens, %zu bytes/token\n", tokens,
+           sizeof(uint8_t) + 3 * sizeof(uint32_t));
+    printf("  speedup: %.2fx\n", lazy / taped);
+
+    free(source);
+}
+
+void csd_bench_count_value(void *user, csd_value value)
+{
+    (void)value;
+    (*(size_t *)user)++;
+}
+
+void csd_bench_events(void)
+{
+    size_t size;
+    char *source = csd_bench_records_source(csd_bench_source_size / 4, &size);
+    const csd_handler counter = {.on_value = &csd_bench_count_value};
+    double tree = 1e30, events = 1e30;
+    size_t values = 0;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        csd_document doc = csd_parse_n(source, size, csd_parse_standard);
+        double elapsed = csd_bench_now() - start;
+        tree = elapsed < tree ? elapsed : tree;
+        csd_free(&doc);
+
+        values = 0;
+        start = csd_bench_now();
+        csd_parse_events_n(source, size, &counter, &values);
+        elapsed = csd_bench_now() - start;
+        events = elapsed < events ? elapsed : events;
+    }
+
+    csd_bench_report("borrowed tree parse", tree, size, "B", size);
+    csd_bench_report("events parse", events, size, "B", size);
+    printf("  %zu values, index window: %d bytes\n", values,
+           csd_index_window_blocks * (int)sizeof(csd_index_block));
+    printf("  speedup: %.2fx\n", tree / events);
+
+    free(source);
+}
+
+void csd_bench_lazy(void)
+{
+    size_t size;
+    char *source = csd_bench_records_source(csd_bench_source_size / 4, &size);
+    const char *keys[] = {"record_0", "record_100", "record_1000", "end"};
+    double tree = 1e30, lazy = 1e30, walk = 1e30;
+    int64_t sink = 0;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        csd_document doc = csd_parse_n(source, size, csd_parse_standard);
+        for (size_t i = 0; i < csd_array_sizeof(keys); i++) {
+            csd_node *node = csd_at(doc.head, keys[i]);
+            if (node->value.type == csd_type_sequence)
+                node = csd_at(node, "width");
+            sink += node->value.as_int;
+        }
+        double elapsed = csd_bench_now() - start;
+        tree = elapsed < tree ? elapsed : tree;
+        csd_free(&doc);
+
+        start = csd_bench_now();
+        doc = csd_parse_lazy(source, size);
+        csd_lazy root = csd_lazy_root(&doc);
+        for (size_t i = 0; i < csd_array_sizeof(keys); i++) {
+            csd_lazy v = csd_lazy_at(root, keys[i]);
+            if (v.type == csd_type_sequence)
+                v = csd_lazy_at(v, "width");
+            sink += csd_lazy_value(v).as_int;
+        }
+        elapsed = csd_bench_now() - start;
+        lazy = elapsed < lazy ? elapsed : lazy;
+        csd_free(&doc);
+
+        /* every record in order, one pass over the root */
+        start = csd_bench_now();
+        doc = csd_parse_lazy(source, size);
+        for (csd_lazy v = csd_lazy_first(csd_lazy_root(&doc)); v.ok; v = csd_lazy_next(v))
+            sink += v.type;
+        elapsed = csd_bench_now() - start;
+        walk = elapsed < walk ? elapsed : walk;
+        csd_free(&doc);
+    }
+
+    csd_bench_report("tree parse, 4 keys", tree, size, "B", size);
+    csd_bench_report("lazy parse, 4 keys", lazy, size, "B", size);
+    csd_bench_report("lazy walk, every key", walk, size, "B", size);
+    printf("  speedup: %.2fx (%lld)\n", tree / lazy, (long long)sink);
+
+    free(source);
+}
+
+void csd_bench_select(void)
+{
+    size_t size;
+    char *source = csd_bench_records_source(csd_bench_source_size / 4, &size);
+    const char *paths[] = {"record_10.width", "record_500.colors[2]", "end"};
+    double tree = 1e30, select = 1e30;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        csd_document doc = csd_parse_n(source, size, csd_parse_standard);
+        double elapsed = csd_bench_now() - start;
+        tree = elapsed < tree ? elapsed : tree;
+        csd_free(&doc);
+
+        start = csd_bench_now();
+        doc = csd_parse_select(source, paths, csd_array_sizeof(paths));
+        elapsed = csd_bench_now() - start;
+        select = elapsed < select ? elapsed : select;
+
+        if (doc.error != csd_ok || csd_count(doc.head) != 3) {
+            fprintf(stderr, "bench select failed: %s\n", doc.reason);
+            exit(1);
+        }
+        csd_free(&doc);
+    }
+
+    csd_bench_report("tree parse", tree, size, "B", size);
+    csd_bench_report("select 3 paths", select, size, "B", size);
+    printf("  speedup: %.2fx\n", tree / select);
+
+    free(source);
+}
+
+void csd_bench_parallel(void)
+{
+    size_t size;
+    char *source = csd_bench_records_source(csd_bench_source_size, &size);
+    const int threads[] = {1, 2, 4, 8, 16};
+    double single = 0;
+
+    for (size_t i = 0; i < csd_array_sizeof(threads); i++) {
+        double best = 1e30;
+        for (int run = 0; run < csd_bench_runs; run++) {
+            csd_parse_options options = {.threads = threads[i]};
+            double start = csd_bench_now();
+            csd_document doc = csd_parse_n(source, size, options);
+            double elapsed = csd_bench_now() - start;
+            best = elapsed < best ? elapsed : best;
+            csd_free(&doc);
+        }
+        single = i ? single : best;
+
+        char name[32];
+        snprintf(name, sizeof(name), "%d threads", threads[i]);
+        csd_bench_report(name, best, size, "B", size);
+        printf("  scaling: %.2fx\n", single / best);
+    }
+    free(source);
+
+    /* below csd_parallel_min_size a parse given threads runs alone */
+    const size_t sizes[] = {1 << 16, 1 << 18, 1 << 20, 1 << 22};
+    for (size_t i = 0; i < csd_array_sizeof(sizes); i++) {
+        source = csd_bench_records_source(sizes[i], &size);
+        double best[2] = {1e30, 1e30};
+        for (int t = 0; t < 2; t++) {
+            for (int run = 0; run < csd_bench_runs; run++) {
+                csd_parse_options options = {.threads = t ? 4 : 1};
+                double start = csd_bench_now();
+                csd_document doc = csd_parse_n(source, size, options);
+                double elapsed = csd_bench_now() - start;
+                best[t] = elapsed < best[t] ? elapsed : best[t];
+                csd_free(&doc);
+            }
+        }
+
+        char name[48];
+        snprintf(name, sizeof(name), "%zu KiB, 4 threads", sizes[i] >> 10);
+        csd_bench_report(name, best[1], size, "B", size);
+        printf("  scaling: %.2fx\n", best[0] / best[1]);
+        free(source);
+    }
+}
+
+void csd_bench_batch(void)
+{
+    const char *record = "tetris {\n"
+                         "  width: 1920, height: -1080, ratio: 1.5, visible: true,\n"
+                         "  title: 'Tetris game', colors: [128, 128, 0x80], # comment\n"
+                         "}\n";
+    const size_t n = 100000;
+    const int threads[] = {1, 2, 4, 8, 16};
+    csd_input *inputs = malloc(n * sizeof(*inputs));
+    csd_document *docs = malloc(n * sizeof(*docs));
+    double single = 0;
+
+    for (size_t i = 0; i < n; i++)
+        inputs[i] = (csd_input){record, strlen(record)};
+
+    double loop = 1e30;
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        for (size_t d = 0; d < n; d++)
+            docs[d] = csd_parse_n(inputs[d].source, inputs[d].size, csd_parse_standard);
+        double elapsed = csd_bench_now() - start;
+        loop = elapsed < loop ? elapsed : loop;
+        for (size_t d = 0; d < n; d++)
+            csd_free(&docs[d]);
+    }
+    csd_bench_report("csd_parse_n loop", loop, n, "doc", n * strlen(record));
+
+    for (size_t i = 0; i < csd_array_sizeof(threads); i++) {
+        csd_pool *pool = csd_pool_new(threads[i], NULL);
+        double best = 1e30;
+        for (int run = 0; run < csd_bench_runs; run++) {
+            double start = csd_bench_now();
+            csd_parse_batch(inputs, n, docs, pool, csd_parse_standard);
+            double elapsed = csd_bench_now() - start;
+            best = elapsed < best ? elapsed : best;
+            for (size_t d = 0; d < n; d++)
+                csd_free(&docs[d]);
+        }
+        single = i ? single : best;
+        csd_pool_free(pool);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%d threads", threads[i]);
+        csd_bench_report(name, best, n, "doc", n * strlen(record));
+        printf("  scaling: %.2fx\n", single / best);
+    }
+
+    free(inputs);
+    free(docs);
+}
+
+double csd_bench_small_documents(const char *source, size_t n)
+{
+    size_t size = strlen(source);
+    double best = 1e30;
+
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        for (size_t i = 0; i < n; i++) {
+            csd_document doc = csd_parse_n(source, size, csd_parse_standard);
+            csd_free(&doc);
+        }
+        double elapsed = csd_bench_now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+void csd_bench_small(void)
+{
+    const char *valid = "tetris { width: 10, height: 20, title: 'Tetris' }";
+    const char *broken = "tetris { width: 10, height: , title: 'Tetris' }";
+    const size_t n = 200000;
+
+    printf("  sizeof(csd_document): %zu bytes\n", sizeof(csd_document));
+    double ok = csd_bench_small_documents(valid, n);
+    csd_bench_report("valid documents", ok, n, "doc", n * strlen(valid));
+    double failed = csd_bench_small_documents(broken, n);
+    csd_bench_report("failing documents", failed, n, "doc", n * strlen(broken));
+}
+
+void csd_bench_arena(void)
+{
+    size_t size;
+    char *source = csd_bench_records_source(csd_bench_source_size / 4, &size);
+    double parse = 1e30;
+    double release = 1e30;
+
+    /* the whole tree is dropped with the arena chunks, not node by node */
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        csd_document doc = csd_parse_n(source, size, csd_parse_standard);
+        double parsed = csd_bench_now();
+        csd_bench_check(&doc);
+        csd_free(&doc);
+        double freed = csd_bench_now();
+
+        parse = parsed - start < parse ? parsed - start : parse;
+        release = freed - parsed < release ? freed - parsed : release;
+    }
+    csd_bench_report("parse", parse, size, "B", size);
+    csd_bench_report("free", release, size, "B", size);
+    printf("  free: %.2f%% of parse\n", 100 * release / parse);
+
+    free(source);
+}
+
+size_t csd_bench_count_values(csd_value *v)
+{
+    size_t count = 1;
+    if (v->type == csd_type_array) {
+        for (size_t i = 0; i < csd_array_len(&v->as_array); i++) {
+            csd_value item = csd_array_at(&v->as_array, i);
+            count += csd_bench_count_values(&item);
+        }
+    } else if (v->type == csd_type_sequence) {
+        for (size_t i = 0; i < csd_sequence_count(&v->as_sequence); i++)
+            count += csd_bench_count_values(&v->as_sequence[i].value->value);
+    }
+    return count;
+}
+
+void csd_bench_memory_parse(const char *name, const char *source, size_t size,
+                            csd_parse_options options)
+{
+    double best = 1e30;
+    csd_document doc;
+    for (int run = 0; run < csd_bench_runs; run++) {
+        if (run)
+            csd_free(&doc);
+        double start = csd_bench_now();
+        doc = csd_parse_n(source, size, options);
+        double elapsed = csd_bench_now() - start;
+        csd_bench_check(&doc);
+        best = elapsed < best ? elapsed : best;
+    }
+
+    /* the arena holds every node, container and value of the tree */
+    size_t values = csd_bench_count_values(&doc.head->value);
+    size_t used = csd_arena_used(doc._arena);
+    printf("  %s: %zu values in %.1f MB, %.2f bytes/value\n", name, values, used / 1e6,
+           (double)used / values);
+    csd_bench_report(name, best, values, "val", size);
+    csd_free(&doc);
+}
+
+void csd_bench_memory(void)
+{
+    const char *unit = "  [128, 64, 32, 255], [0.5, 0.25, -1.0, 1e3],\n";
+    size_t unit_size = strlen(unit);
+    size_t count = csd_bench_source_size / 4 / unit_size;
+    char *source = malloc(count * unit_size + 32);
+    char *it = source;
+
+    it += sprintf(it, "gray: [\n");
+    for (size_t i = 0; i < count; i++) {
+        memcpy(it, unit, unit_size);
+        it += unit_size;
+    }
+    it += sprintf(it, "]");
+    size_t size = it - source;
+
+#ifdef csd_wide_values
+    printf("  layout: wide\n");
+#else
+    printf("  layout: compact\n");
+#endif
+    printf("  sizeof(csd_value): %zu bytes, sizeof(csd_node): %zu bytes\n",
+           sizeof(csd_value), sizeof(csd_node));
+
+    csd_parse_options packed = csd_parse_standard;
+    packed.packed_arrays = true;
+    csd_bench_memory_parse("tagged arrays", source, size, csd_parse_standard);
+    csd_bench_memory_parse("packed arrays", source, size, packed);
+    free(source);
+}
+
+void csd_bench_strings(void)
+{
+    const char *words[] = {"Yes",       "No",        "OK",      "Cancel",
+                           "Save file", "Quit game", "l\\'heure"};
+    const size_t count = 200000;
+    char *source = malloc(count * 32 + 16);
+    char *it = source;
+
+    /* a localization table, one short string per key */
+    it += sprintf(it, "fr_FR {\n");
+    for (size_t i = 0; i < count; i++)
+        it += sprintf(it, "  label_%zu: '%s',\n", i, words[i % csd_array_sizeof(words)]);
+    it += sprintf(it, "}");
+    size_t size = it - source;
+
+    /* the tables come from two sources, like two files would */
+    char *copy = strdup(source);
+    csd_document a = csd_parse_n(source, size, csd_parse_standard);
+    csd_document b = csd_parse_n(copy, size, csd_parse_standard);
+    csd_bench_check(&a);
+    csd_bench_check(&b);
+
+    double best = 1e30;
+    for (int run = 0; run < csd_bench_runs; run++) {
+        double start = csd_bench_now();
+        bool eq = csd_eq(a.head, b.head);
+        double elapsed = csd_bench_now() - start;
+        if (!eq)
+            exit(1);
+        best = elapsed < best ? elapsed : best;
+    }
+    csd_bench_report("compare tables", best, count, "str", size);
+
+    csd_free(&a);
+    csd_free(&b);
+    free(copy);
+    free(source);
+}
+
+const csd_bench csd_benches[] = {
+    {"token-rate", &csd_bench_token_rate},
+    {"escape-density", &csd_bench_escape_density},
+    {"numbers", &csd_bench_numbers},
+    {"tape", &csd_bench_tape},
+    {"events", &csd_bench_events},
+    {"lazy", &csd_bench_lazy},
+    {"select", &csd_bench_select},
+    {"parallel", &csd_bench_parallel},
+    {"batch", &csd_bench_batch},
+    {"small", &csd_bench_small},
+    {"arena", &csd_bench_arena},
+    {"memory", &csd_bench_memory},
+    {"strings", &csd_bench_strings},
+    {NULL, NULL},
+};
+
+int main(int argc, char **argv)
+{
+    for (const csd_bench *bench = csd_benches; bench->name != NULL; bench++) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++)
+            selected |= strcmp(argv[i], bench->name) == 0;
+        if (!selected)
+            continue;
+
+        printf("%s\n", bench->name);
+        bench->run();
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "csd.h"
+#include "csd_ds.h"
+
+extern csd_token_mask csd_value_mask;
+extern csd_token_mask csd_item_mask;
+
+csd_token csd_expect(csd_document *doc, csd_token_mask mask);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_token csd_queue_token(csd_document *doc, csd_token token);
+csd_value csd_parse_value(csd_document *doc, csd_token_mask mask);
+void csd_skip_value(csd_document *doc, csd_token token);
+const char *csd_doc_strndup(csd_document *doc, const char *s, size_t size);
+void csd_doc_reset(csd_document *doc);
+
+#define csd_cursor_containers (csd_token_scope_begin | csd_token_array_begin)
+
+csd_error csd_cursor_open(csd_cursor *c, const char *source, size_t size)
+{
+    *c = (csd_cursor){0};
+    csd_document *doc = &c->doc;
+    doc->source = (char *)source;
+    doc->size = size;
+    doc->_stream = doc->source;
+    doc->_source_kind = csd_source_borrowed;
+    doc->_scanner = &c->_scanner;
+
+    /* records are read one at a time, only a window of the index is kept alive */
+    if (!csd_index_window(&c->_scanner.index, doc->source, doc->size) ||
+        !csd_ds_reserve(c->stack, 1)) {
+        csd_memory_fail(doc);
+        return doc->error;
+    }
+    arrpush(c->stack, ((csd_cursor_frame){csd_cursor_document, true, false}));
+    return csd_ok;
+}
+
+void csd_cursor_close(csd_cursor *c)
+{
+    csd_free(&c->doc);
+    arrfree(c->stack);
+}
+
+static bool csd_cursor_push(csd_cursor *c, csd_cursor_kind kind)
+{
+    if (!csd_ds_reserve(c->stack, arrlen(c->stack) + 1)) {
+        csd_memory_fail(&c->doc);
+        return false;
+    }
+    arrlast(c->stack).after_sequence = kind == csd_cursor_sequence;
+    arrpush(c->stack, ((csd_cursor_frame){kind, true, false}));
+    return true;
+}
+
+static void csd_cursor_pop(csd_cursor *c)
+{
+    (void)arrpop(c->stack);
+}
+
+/* moves to the next element of the current container, leaving it at its end */
+static bool csd_cursor_element(csd_cursor *c)
+{
+    csd_document *doc = &c->doc;
+    csd_cursor_frame *frame = &arrlast(c->stack);
+    bool first = frame->first;
+    frame->first = false;
+
+    if (frame->kind == csd_cursor_document)
+        return first && !csd_read(doc, csd_token_eof).ok;
+
+    csd_token_mask end =
+        frame->kind == csd_cursor_sequence ? csd_token_scope_end : csd_token_array_end;
+    if (first) {
+        if (!csd_read(doc, end).ok)
+            return true;
+        csd_cursor_pop(c);
+        return false;
+    }
+
+    /* a nested sequence closes itself, the comma after it is optional */
+    csd_token_mask separator = end | csd_token_comma;
+    if (frame->kind == csd_cursor_sequence && frame->after_sequence)
+        separator |= csd_token_id | csd_token_scope_begin;
+
+    csd_token token = csd_expect(doc, separator);
+    if (!token.ok)
+        return false;
+    if (token.type & end) {
+        csd_cursor_pop(c);
+        return false;
+    }
+    if (token.type & (csd_token_id | csd_token_scope_begin)) {
+        csd_queue_token(doc, token);
+    } else if (csd_read(doc, end).ok) {
+        /* trailing comma */
+        csd_cursor_pop(c);
+        return false;
+    }
+    return true;
+}
+
+/* reads the key of a node and returns the first token of its value */
+static csd_token csd_cursor_header(csd_cursor *c)
+{
+    csd_document *doc = &c->doc;
+
+    if (arrlast(c->stack).kind == csd_cursor_array) {
+        c->key = "";
+        return csd_expect(doc, csd_item_mask);
+    }
+
+    csd_token token = csd_expect(doc, csd_token_id | csd_token_scope_begin);
+    if (!token.ok || token.type == csd_token_scope_begin) {
+        c->key = "";
+        return token;
+    }
+
+    c->key = csd_doc_strndup(doc, token.expr, token.size);
+    token = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
+    if (token.ok && token.type == csd_token_assign)
+        token = csd_expect(doc, csd_value_mask);
+    return token;
+}
+
+csd_node *csd_cursor_next_value(csd_cursor *c)
+{
+    csd_document *doc = &c->doc;
+    if (doc->error != csd_ok)
+        return NULL;
+
+    /* the previous element is released, the document only ever holds one */
+    csd_doc_reset(doc);
+    c->key = NULL;
+    if (!csd_cursor_element(c))
+        return NULL;
+
+    csd_token token = csd_cursor_header(c);
+    if (!token.ok)
+        return NULL;
+    csd_queue_token(doc, token);
+    csd_node *node = csd_new_nil(doc, c->key);
+    if (!node)
+        return NULL;
+    node->value = csd_parse_value(doc, token.type);
+    if (doc->error != csd_ok)
+        return NULL;
+    arrlast(c->stack).after_sequence = node->value.type == csd_type_sequence;
+    doc->head = node;
+    return node;
+}
+
+bool csd_cursor_skip(csd_cursor *c)
+{
+    csd_document *doc = &c->doc;
+    if (doc->error != csd_ok)
+        return false;
+
+    csd_doc_reset(doc);
+    c->key = NULL;
+    if (!csd_cursor_element(c))
+        return false;
+
+    csd_token token = csd_cursor_header(c);
+    if (!token.ok)
+        return false;
+    arrlast(c->stack).after_sequence = token.type == csd_token_scope_begin;
+    csd_skip_value(doc, token);
+    return doc->error == csd_ok;
+}
+
+bool csd_cursor_enter(csd_cursor *c)
+{
+    csd_document *doc = &c->doc;
+    if (doc->error != csd_ok)
+        return false;
+
+    csd_doc_reset(doc);
+    c->key = NULL;
+    if (!csd_cursor_element(c))
+        return false;
+
+    csd_token token = csd_cursor_header(c);
+    if (!token.ok)
+        return false;
+    if (!(token.type & csd_cursor_containers)) {
+        csd_expect_fail(doc, token, csd_cursor_containers);
+        return false;
+    }
+    return csd_cursor_push(c, token.type == csd_token_scope_begin ? csd_cursor_sequence
+                                                                   : csd_cursor_array);
+}
@@ -0,0 +1,19 @@
+#ifndef CSD_DS_H
+#define CSD_DS_H
+
+#include "csd.h"
+
+/* stb_ds goes through the allocator made current with csd_ds_use */
+void *csd_ds_realloc(void *p, size_t size);
+void csd_ds_free(void *p);
+const csd_allocator *csd_ds_use(const csd_allocator *a);
+
+#define STBDS_REALLOC(context, ptr, size) csd_ds_realloc(ptr, size)
+#define STBDS_FREE(context, ptr) csd_ds_free(ptr)
+#include "stb_ds.h"
+
+/* stb_ds cannot fail, its arrays are reserved first and a failed reserve is reported */
+bool csd_ds_grow(void **a, size_t element_size, size_t capacity);
+#define csd_ds_reserve(a, capacity) csd_ds_grow((void **)&(a), sizeof(*(a)), (capacity))
+
+#endif
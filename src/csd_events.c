@@ -0,0 +1,171 @@
+#include "csd.h"
+
+extern csd_token_mask csd_value_mask;
+extern csd_token_mask csd_item_mask;
+
+csd_token csd_expect(csd_document *doc, csd_token_mask mask);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_token csd_queue_token(csd_document *doc, csd_token token);
+csd_value csd_token_value(csd_document *doc, csd_token vtoken);
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+
+typedef struct csd_events
+{
+    csd_document doc;
+    csd_scanner scanner;
+    const csd_handler *h;
+    void *user;
+} csd_events;
+
+#define csd_emit(e, callback, ...)                                                      \
+    do {                                                                                \
+        if ((e)->h->callback)                                                           \
+            (e)->h->callback((e)->user, ##__VA_ARGS__);                                 \
+    } while (0)
+
+/* reads the key of the next node and returns the first token of its value */
+static csd_token csd_events_key(csd_events *e)
+{
+    csd_document *doc = &e->doc;
+    csd_token token = csd_expect(doc, csd_token_id | csd_token_scope_begin);
+    if (!token.ok)
+        return token;
+    if (token.type == csd_token_scope_begin) {
+        csd_emit(e, on_key, "", 0);
+        return token;
+    }
+
+    csd_emit(e, on_key, token.expr, token.size);
+    token = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
+    if (token.ok && token.type == csd_token_assign)
+        token = csd_expect(doc, csd_value_mask);
+    return token;
+}
+
+static void csd_events_scalar(csd_events *e, csd_token token)
+{
+    csd_value value = csd_token_value(&e->doc, token);
+    if (e->doc.error == csd_ok)
+        csd_emit(e, on_value, value);
+}
+
+/* like csd_parse_tree, containers are walked with an explicit stack of their kinds */
+static void csd_events_tree(csd_events *e, csd_token vtoken)
+{
+    const csd_token_mask containers = csd_token_scope_begin | csd_token_array_begin;
+    csd_document *doc = &e->doc;
+    size_t max_depth = doc->_max_depth ? doc->_max_depth : csd_default_max_depth;
+    bool frames[csd_parse_stack_frames];
+    bool *stack = frames;
+    size_t capacity = csd_array_sizeof(frames);
+    size_t depth = 0;
+    bool open = vtoken.type & containers;
+    bool closed = false;
+    bool nested = false;
+
+    if (!open) {
+        csd_events_scalar(e, vtoken);
+        return;
+    }
+
+    while (1) {
+        if (open) {
+            if (depth >= max_depth) {
+                csd_parse_fail(doc, vtoken, "nesting exceeds the maximum depth of %zu",
+                               max_depth);
+                break;
+            }
+            if (depth == capacity) {
+                bool *grown =
+                    csd_mem_alloc(doc->allocator, 2 * capacity * sizeof(*stack));
+                if (!grown) {
+                    csd_memory_fail(doc);
+                    break;
+                }
+                memcpy(grown, stack, depth * sizeof(*stack));
+                if (stack != frames)
+                    csd_mem_free(doc->allocator, stack);
+                stack = grown;
+                capacity *= 2;
+            }
+            stack[depth] = vtoken.type == csd_token_scope_begin;
+            if (stack[depth++])
+                csd_emit(e, on_sequence_begin);
+            else
+                csd_emit(e, on_array_begin);
+            open = false;
+        }
+
+        bool sequence = stack[depth - 1];
+        csd_token_mask end = sequence ? csd_token_scope_end : csd_token_array_end;
+
+        if (closed || csd_read(doc, end).ok) {
+            if (sequence)
+                csd_emit(e, on_sequence_end);
+            else
+                csd_emit(e, on_array_end);
+            if (!--depth)
+                break;
+            nested = sequence;
+            sequence = stack[depth - 1];
+            end = sequence ? csd_token_scope_end : csd_token_array_end;
+        } else {
+            vtoken = sequence ? csd_events_key(e) : csd_expect(doc, csd_item_mask);
+            if (!vtoken.ok)
+                break;
+            open = vtoken.type & containers;
+            if (open)
+                continue;
+            csd_events_scalar(e, vtoken);
+            nested = false;
+        }
+
+        /* a nested sequence closes itself, the comma after it is optional */
+        csd_token_mask separator = end | csd_token_comma;
+        if (sequence && nested)
+            separator |= csd_token_id | csd_token_scope_begin;
+
+        csd_token token = csd_expect(doc, separator);
+        if (!token.ok)
+            break;
+        closed = token.type & end;
+        if (token.type & (csd_token_id | csd_token_scope_begin))
+            csd_queue_token(doc, token);
+    }
+
+    if (stack != frames)
+        csd_mem_free(doc->allocator, stack);
+}
+
+csd_error csd_parse_events(const char *source, const csd_handler *h, void *user)
+{
+    return csd_parse_events_n(source, strlen(source), h, user);
+}
+
+csd_error csd_parse_events_n(const char *source, size_t size, const csd_handler *h,
+                             void *user)
+{
+    csd_events e = {.h = h, .user = user};
+    csd_document *doc = &e.doc;
+    doc->source = (char *)source;
+    doc->size = size;
+    doc->_stream = doc->source;
+    doc->_source_kind = csd_source_borrowed;
+    doc->_scanner = &e.scanner;
+
+    /* no tree is built, only a window of the index is kept alive */
+    if (!csd_index_window(&e.scanner.index, doc->source, doc->size))
+        csd_memory_fail(doc);
+    else if (!csd_read(doc, csd_token_eof).ok) {
+        csd_token vtoken = csd_events_key(&e);
+        if (vtoken.ok)
+            csd_events_tree(&e, vtoken);
+    }
+    if (doc->error != csd_ok)
+        csd_emit(&e, on_error, doc->error, doc->reason);
+
+    csd_error error = doc->error;
+    csd_free(doc);
+    return error;
+}
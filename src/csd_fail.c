@@ -0,0 +1,130 @@
+#include "csd.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+
+void csd_vprintf(char *s, size_t size, const char *format, va_list args)
+{
+    size_t length = strlen(s);
+    vsnprintf(s + length, size - length, format, args);
+}
+
+void csd_printf(char *s, size_t size, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    csd_vprintf(s, size, format, args);
+    va_end(args);
+}
+
+void csd_source_position(csd_document *doc, size_t offset, int *line, int *column)
+{
+    const char *it = doc->source;
+    const char *end = &doc->source[offset];
+    const char *newline;
+
+    *line = doc->_origin_line;
+    *column = doc->_origin_column;
+    while ((newline = memchr(it, '\n', end - it)) != NULL) {
+        (*line)++;
+        *column = 0;
+        it = newline + 1;
+    }
+    *column += end - it;
+}
+
+/* the first failure wins, the scanner is moved to the end so every later read fails */
+static bool csd_fail_begin(csd_document *doc, csd_error error)
+{
+    if (doc->source)
+        doc->_stream = &doc->source[doc->size];
+    if (doc->_scanner) {
+        doc->_scanner->has_queued_token = false;
+        doc->_scanner->tape.count = 0;
+    }
+
+    if (doc->error != csd_ok)
+        return false;
+    doc->error = error;
+    return true;
+}
+
+static void csd_fail_end(csd_document *doc, const char *reason)
+{
+    /* without memory for the reason the error alone is reported */
+    size_t size = strlen(reason) + 1;
+    doc->reason = csd_mem_alloc(doc->allocator, size);
+    if (doc->reason)
+        memcpy(doc->reason, reason, size);
+}
+
+static void csd_source_error(csd_document *doc, csd_token token, const char *format,
+                             va_list args)
+{
+    char reason[csd_reason_size] = {0};
+    int line, column;
+    csd_source_position(doc, token.offset, &line, &column);
+    csd_printf(reason, csd_reason_size, "(%d:%d) ", line, column);
+    csd_vprintf(reason, csd_reason_size, format, args);
+    csd_fail_end(doc, reason);
+}
+
+void csd_fail(csd_document *doc, csd_error error, const char *format, ...)
+{
+    if (!csd_fail_begin(doc, error))
+        return;
+
+    char reason[csd_reason_size] = {0};
+    va_list args;
+    va_start(args, format);
+    csd_vprintf(reason, csd_reason_size, format, args);
+    va_end(args);
+    csd_fail_end(doc, reason);
+}
+
+void csd_file_fail(csd_document *doc, const char *filepath, const char *format, ...)
+{
+    if (!csd_fail_begin(doc, csd_file_error))
+        return;
+
+    char reason[csd_reason_size] = {0};
+    va_list args;
+    va_start(args, format);
+    csd_printf(reason, csd_reason_size, "file '%s': ", filepath);
+    csd_vprintf(reason, csd_reason_size, format, args);
+    va_end(args);
+    csd_fail_end(doc, reason);
+}
+
+/* an allocation failed, the document cannot be completed */
+void csd_memory_fail(csd_document *doc)
+{
+    csd_fail(doc, csd_memory_error, "out of memory");
+}
+
+csd_token csd_scan_fail(csd_document *doc, csd_token token, const char *format, ...)
+{
+    if (csd_fail_begin(doc, csd_scan_error)) {
+        va_list args;
+        va_start(args, format);
+        csd_source_error(doc, token, format, args);
+        va_end(args);
+    }
+
+    token.type = csd_token_none;
+    token.ok = false;
+    return token;
+}
+
+void csd_parse_fail(csd_document *doc, csd_token token, const char *format, ...)
+{
+    if (!csd_fail_begin(doc, csd_scan_error))
+        return;
+
+    va_list args;
+    va_start(args, format);
+    csd_source_error(doc, token, format, args);
+    va_end(args);
+}
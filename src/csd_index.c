@@ -0,0 +1,238 @@
+#include "csd.h"
+#include "csd_ds.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+static const uint8_t csd_index_classes[256] = {
+    [' '] = csd_index_whitespace,  ['\t'] = csd_index_whitespace,
+    ['\n'] = csd_index_whitespace, ['\r'] = csd_index_whitespace,
+    ['\v'] = csd_index_whitespace, ['\f'] = csd_index_whitespace,
+    ['{'] = csd_index_structural,  ['}'] = csd_index_structural,
+    ['['] = csd_index_structural,  [']'] = csd_index_structural,
+    [':'] = csd_index_structural,  [','] = csd_index_structural,
+    ['#'] = csd_index_structural,
+    ['\''] = csd_index_quote,      ['"'] = csd_index_quote,
+    ['\\'] = csd_index_backslash,
+};
+
+#if defined(__AVX2__)
+
+typedef __m256i csd_vec;
+#define csd_vec_width 32
+#define csd_vec_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define csd_vec_set1 _mm256_set1_epi8
+#define csd_vec_eq _mm256_cmpeq_epi8
+#define csd_vec_or _mm256_or_si256
+#define csd_vec_sub _mm256_sub_epi8
+#define csd_vec_min _mm256_min_epu8
+#define csd_vec_mask(v) (uint64_t)(uint32_t) _mm256_movemask_epi8(v)
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+typedef __m128i csd_vec;
+#define csd_vec_width 16
+#define csd_vec_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define csd_vec_set1 _mm_set1_epi8
+#define csd_vec_eq _mm_cmpeq_epi8
+#define csd_vec_or _mm_or_si128
+#define csd_vec_sub _mm_sub_epi8
+#define csd_vec_min _mm_min_epu8
+#define csd_vec_mask(v) (uint64_t)(uint16_t) _mm_movemask_epi8(v)
+
+#endif
+
+#ifdef csd_vec_width
+
+static void csd_index_classify(csd_index_block *block, const char *s)
+{
+    *block = (csd_index_block){0};
+
+    for (int i = 0; i < csd_index_block_size; i += csd_vec_width) {
+        csd_vec v = csd_vec_load(&s[i]);
+        /* '\t' to '\r' are contiguous, '[' ']' fold onto '{' '}' once 0x20 is set */
+        csd_vec control = csd_vec_sub(v, csd_vec_set1('\t'));
+        csd_vec folded = csd_vec_or(v, csd_vec_set1(0x20));
+
+        csd_vec whitespace =
+            csd_vec_or(csd_vec_eq(v, csd_vec_set1(' ')),
+                       csd_vec_eq(csd_vec_min(control, csd_vec_set1('\r' - '\t')), control));
+        csd_vec structural = csd_vec_or(
+            csd_vec_or(csd_vec_eq(folded, csd_vec_set1('{')),
+                       csd_vec_eq(folded, csd_vec_set1('}'))),
+            csd_vec_or(csd_vec_or(csd_vec_eq(v, csd_vec_set1(':')),
+                                  csd_vec_eq(v, csd_vec_set1(','))),
+                       csd_vec_eq(v, csd_vec_set1('#'))));
+        csd_vec quote =
+            csd_vec_or(csd_vec_eq(v, csd_vec_set1('\'')), csd_vec_eq(v, csd_vec_set1('"')));
+        csd_vec backslash = csd_vec_eq(v, csd_vec_set1('\\'));
+
+        block->whitespace |= csd_vec_mask(whitespace) << i;
+        block->structural |= csd_vec_mask(structural) << i;
+        block->quote |= csd_vec_mask(quote) << i;
+        block->backslash |= csd_vec_mask(backslash) << i;
+    }
+}
+
+#else
+
+static void csd_index_classify(csd_index_block *block, const char *s)
+{
+    *block = (csd_index_block){0};
+
+    for (int i = 0; i < csd_index_block_size; i++) {
+        uint8_t c = csd_index_classes[(uint8_t)s[i]];
+        block->whitespace |= (uint64_t)((c & csd_index_whitespace) != 0) << i;
+        block->structural |= (uint64_t)((c & csd_index_structural) != 0) << i;
+        block->quote |= (uint64_t)((c & csd_index_quote) != 0) << i;
+        block->backslash |= (uint64_t)((c & csd_index_backslash) != 0) << i;
+    }
+}
+
+#endif
+
+static void csd_index_classify_range(csd_index_block *blocks, const char *source,
+                                     size_t size, size_t from, size_t to)
+{
+    size_t whole = size / csd_index_block_size;
+
+    for (size_t i = from; i < to && i < whole; i++) {
+        csd_index_classify(&blocks[i - from], &source[i * csd_index_block_size]);
+    }
+    if (whole >= from && whole < to) {
+        char tail[csd_index_block_size] = {0};
+        memcpy(tail, &source[whole * csd_index_block_size],
+               size - whole * csd_index_block_size);
+        csd_index_classify(&blocks[whole - from], tail);
+    }
+}
+
+bool csd_index_build(csd_index *index, const char *source, size_t size)
+{
+    return csd_index_extend(index, source, size, 0);
+}
+
+/* the blocks before block are kept, the source grew past them */
+bool csd_index_extend(csd_index *index, const char *source, size_t size, size_t block)
+{
+    if (!csd_index_reserve(index, size))
+        return false;
+    csd_index_fill(index, source, block < index->count ? block : index->count,
+                   index->count);
+    return true;
+}
+
+bool csd_index_reserve(csd_index *index, size_t size)
+{
+    size_t count = (size + csd_index_block_size - 1) / csd_index_block_size;
+    if (!csd_ds_reserve(index->blocks, count))
+        return false;
+    index->size = size;
+    index->count = count;
+    index->first = 0;
+    index->source = NULL;
+    arrsetlen(index->blocks, index->count);
+    return true;
+}
+
+void csd_index_fill(csd_index *index, const char *source, size_t from, size_t to)
+{
+    csd_index_classify_range(&index->blocks[from], source, index->size, from, to);
+}
+
+bool csd_index_window(csd_index *index, const char *source, size_t size)
+{
+    /* blocks are classified on demand, a window at a time, as the scanner advances */
+    size_t count = (size + csd_index_block_size - 1) / csd_index_block_size;
+    size_t window = count < csd_index_window_blocks ? count : csd_index_window_blocks;
+    if (!csd_ds_reserve(index->blocks, window))
+        return false;
+    index->size = size;
+    index->count = count;
+    index->first = 0;
+    index->source = source;
+    arrsetlen(index->blocks, 0);
+    return true;
+}
+
+void csd_index_free(csd_index *index)
+{
+    arrfree(index->blocks);
+    index->size = 0;
+    index->count = 0;
+}
+
+csd_index_class csd_index_classof(char c)
+{
+    return csd_index_classes[(uint8_t)c];
+}
+
+static void csd_index_slide(csd_index *index, size_t block)
+{
+    size_t to = block + csd_index_window_blocks;
+    to = to < index->count ? to : index->count;
+
+    index->first = block;
+    arrsetlen(index->blocks, to - block);
+    csd_index_classify_range(index->blocks, index->source, index->size, block, to);
+}
+
+static inline const csd_index_block *csd_index_block_at(csd_index *index, size_t block)
+{
+    if (block - index->first >= (size_t)arrlen(index->blocks))
+        csd_index_slide(index, block);
+    return &index->blocks[block - index->first];
+}
+
+static inline uint64_t csd_index_bits(const csd_index_block *block,
+                                      csd_index_class classes)
+{
+    uint64_t bits = 0;
+    if (classes & csd_index_whitespace)
+        bits |= block->whitespace;
+    if (classes & csd_index_structural)
+        bits |= block->structural;
+    if (classes & csd_index_quote)
+        bits |= block->quote;
+    if (classes & csd_index_backslash)
+        bits |= block->backslash;
+    return bits;
+}
+
+uint64_t csd_index_mask(csd_index *index, size_t block, csd_index_class classes)
+{
+    return csd_index_bits(csd_index_block_at(index, block), classes);
+}
+
+static size_t csd_index_find(csd_index *index, size_t at, csd_index_class classes,
+                             uint64_t invert)
+{
+    size_t i = at / csd_index_block_size;
+    if (i >= index->count)
+        return index->size;
+
+    uint64_t bits = csd_index_mask(index, i, classes) ^ invert;
+    bits &= ~0ull << (at % csd_index_block_size);
+
+    while (!bits) {
+        if (++i >= index->count)
+            return index->size;
+        bits = csd_index_mask(index, i, classes) ^ invert;
+    }
+
+    size_t next = i * csd_index_block_size + csd_ctz64(bits);
+    return next < index->size ? next : index->size;
+}
+
+size_t csd_index_next(csd_index *index, size_t at, csd_index_class classes)
+{
+    return csd_index_find(index, at, classes, 0);
+}
+
+size_t csd_index_skip(csd_index *index, size_t at, csd_index_class classes)
+{
+    return csd_index_find(index, at, classes, ~0ull);
+}
@@ -0,0 +1,244 @@
+#include "csd.h"
+#include <assert.h>
+
+extern csd_token_mask csd_value_mask;
+extern csd_token_mask csd_item_mask;
+
+csd_token csd_expect(csd_document *doc, csd_token_mask mask);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_token csd_queue_token(csd_document *doc, csd_token token);
+csd_value csd_parse_value(csd_document *doc, csd_token_mask mask);
+void csd_skip_value(csd_document *doc, csd_token vtoken);
+csd_arena *csd_doc_arena(csd_document *doc);
+void csd_doc_release(csd_document *doc);
+void *csd_arena_alloc(csd_arena *arena, size_t size);
+
+static const csd_lazy csd_lazy_none = {0};
+
+csd_document csd_parse_lazy(const char *source, size_t size)
+{
+    csd_document doc = {0};
+    doc.source = (char *)source;
+    doc.size = size;
+    doc._stream = doc.source;
+    doc._source_kind = csd_source_borrowed;
+
+    /*
+     * values are scanned and parsed when they are read. the index is a window classified
+     * as the reads move, one going back to an earlier value classifies it again.
+     */
+    csd_arena *arena = csd_doc_arena(&doc);
+    doc._scanner = arena ? csd_arena_alloc(arena, sizeof(csd_scanner)) : NULL;
+    if (doc._scanner)
+        *doc._scanner = (csd_scanner){0};
+    if (!doc._scanner || !csd_index_window(&doc._scanner->index, doc.source, doc.size)) {
+        csd_memory_fail(&doc);
+        csd_doc_release(&doc);
+    }
+    return doc;
+}
+
+static csd_type csd_lazy_typeof(csd_token_type type)
+{
+    switch (type) {
+    case csd_token_scope_begin:
+        return csd_type_sequence;
+    case csd_token_array_begin:
+        return csd_type_array;
+    case csd_token_string:
+        return csd_type_string;
+    case csd_token_float:
+        return csd_type_float;
+    case csd_token_int:
+    case csd_token_int_hex:
+    case csd_token_int_binary:
+        return csd_type_int;
+    case csd_token_true:
+    case csd_token_false:
+        return csd_type_boolean;
+    default:
+        assert(!"unreachable");
+    }
+}
+
+static csd_lazy csd_lazy_make(csd_document *doc, csd_token vtoken, csd_type parent)
+{
+    /* string tokens start past their opening quote */
+    size_t offset = vtoken.offset - (vtoken.type == csd_token_string);
+    return (csd_lazy){doc, offset, csd_lazy_typeof(vtoken.type), true, parent};
+}
+
+static csd_token csd_lazy_seek(csd_document *doc, size_t offset, csd_token_mask mask)
+{
+    doc->_stream = &doc->source[offset];
+    doc->_scanner->has_queued_token = false;
+    return csd_expect(doc, mask);
+}
+
+/* reads the key of the next node and returns the first token of its value */
+static csd_token csd_lazy_node(csd_document *doc, csd_token *key)
+{
+    *key = csd_expect(doc, csd_token_id | csd_token_scope_begin);
+    if (!key->ok || key->type == csd_token_scope_begin) {
+        csd_token vtoken = *key;
+        key->size = 0;
+        return vtoken;
+    }
+
+    csd_token vtoken = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
+    if (vtoken.ok && vtoken.type == csd_token_assign)
+        vtoken = csd_expect(doc, csd_value_mask);
+    return vtoken;
+}
+
+csd_lazy csd_lazy_root(csd_document *doc)
+{
+    if (doc->error != csd_ok)
+        return csd_lazy_none;
+
+    doc->_stream = doc->source;
+    doc->_scanner->has_queued_token = false;
+    if (csd_read(doc, csd_token_eof).ok)
+        return csd_lazy_none;
+
+    csd_token key;
+    csd_token vtoken = csd_lazy_node(doc, &key);
+    if (!vtoken.ok)
+        return csd_lazy_none;
+    return csd_lazy_make(doc, vtoken, csd_type_nil);
+}
+
+/* reads the next element of a container and returns its value token, not ok at the end */
+static csd_token csd_lazy_element(csd_document *doc, bool sequence, csd_token *name)
+{
+    csd_token_mask end = sequence ? csd_token_scope_end : csd_token_array_end;
+    csd_token vtoken = csd_read(doc, end);
+    if (vtoken.ok) {
+        vtoken.ok = false;
+        return vtoken;
+    }
+    return sequence ? csd_lazy_node(doc, name) : csd_expect(doc, csd_item_mask);
+}
+
+/* skips the element value and its separator, false once the container ends */
+static bool csd_lazy_skip(csd_document *doc, bool sequence, csd_token vtoken)
+{
+    csd_token_mask end = sequence ? csd_token_scope_end : csd_token_array_end;
+    csd_skip_value(doc, vtoken);
+
+    /* a nested sequence closes itself, the comma after it is optional */
+    csd_token_mask separator = end | csd_token_comma;
+    if (sequence && vtoken.type == csd_token_scope_begin)
+        separator |= csd_token_id | csd_token_scope_begin;
+
+    csd_token token = csd_expect(doc, separator);
+    if (!token.ok || token.type & end)
+        return false;
+    if (token.type & (csd_token_id | csd_token_scope_begin))
+        csd_queue_token(doc, token);
+    return true;
+}
+
+/* walks the elements of a container, stopping at the element matching key or index */
+static csd_lazy csd_lazy_find(csd_lazy v, const char *key, size_t index, size_t *count)
+{
+    csd_document *doc = v.doc;
+    bool sequence = v.type == csd_type_sequence;
+    csd_token_mask begin = sequence ? csd_token_scope_begin : csd_token_array_begin;
+    size_t key_size = key ? strlen(key) : 0;
+
+    if (!csd_lazy_seek(doc, v.offset, begin).ok)
+        return csd_lazy_none;
+    for (*count = 0;; (*count)++) {
+        csd_token name = {0};
+        csd_token vtoken = csd_lazy_element(doc, sequence, &name);
+        if (!vtoken.ok)
+            return csd_lazy_none;
+        if (key && name.size == key_size && !memcmp(name.expr, key, key_size))
+            return csd_lazy_make(doc, vtoken, v.type);
+        if (!key && *count == index)
+            return csd_lazy_make(doc, vtoken, v.type);
+        if (!csd_lazy_skip(doc, sequence, vtoken)) {
+            (*count)++;
+            return csd_lazy_none;
+        }
+    }
+}
+
+csd_lazy csd_lazy_first(csd_lazy v)
+{
+    if (!v.ok || v.doc->error != csd_ok)
+        return csd_lazy_none;
+    if (v.type != csd_type_sequence && v.type != csd_type_array)
+        return csd_lazy_none;
+
+    bool sequence = v.type == csd_type_sequence;
+    csd_token name;
+    csd_token_mask begin = sequence ? csd_token_scope_begin : csd_token_array_begin;
+    if (!csd_lazy_seek(v.doc, v.offset, begin).ok)
+        return csd_lazy_none;
+    csd_token vtoken = csd_lazy_element(v.doc, sequence, &name);
+    return vtoken.ok ? csd_lazy_make(v.doc, vtoken, v.type) : csd_lazy_none;
+}
+
+/* starts from the element itself, so a walk costs one pass over the container */
+csd_lazy csd_lazy_next(csd_lazy element)
+{
+    if (!element.ok || element.doc->error != csd_ok || element._parent == csd_type_nil)
+        return csd_lazy_none;
+
+    csd_document *doc = element.doc;
+    bool sequence = element._parent == csd_type_sequence;
+    csd_token name;
+    csd_token vtoken = csd_lazy_seek(doc, element.offset, csd_value_mask | csd_item_mask);
+    if (!vtoken.ok || !csd_lazy_skip(doc, sequence, vtoken))
+        return csd_lazy_none;
+    vtoken = csd_lazy_element(doc, sequence, &name);
+    return vtoken.ok ? csd_lazy_make(doc, vtoken, element._parent) : csd_lazy_none;
+}
+
+csd_lazy csd_lazy_at(csd_lazy v, const char *key)
+{
+    size_t count;
+    if (!v.ok || v.type != csd_type_sequence || v.doc->error != csd_ok)
+        return csd_lazy_none;
+    return csd_lazy_find(v, key, 0, &count);
+}
+
+csd_lazy csd_lazy_index(csd_lazy v, size_t i)
+{
+    size_t count;
+    if (!v.ok || v.type != csd_type_array || v.doc->error != csd_ok)
+        return csd_lazy_none;
+    return csd_lazy_find(v, NULL, i, &count);
+}
+
+size_t csd_lazy_len(csd_lazy v)
+{
+    size_t count = 0;
+    if (!v.ok || v.doc->error != csd_ok)
+        return 0;
+    if (v.type != csd_type_sequence && v.type != csd_type_array)
+        return 0;
+
+    csd_lazy_find(v, NULL, SIZE_MAX, &count);
+    return v.doc->error == csd_ok ? count : 0;
+}
+
+csd_value csd_lazy_value(csd_lazy v)
+{
+    if (!v.ok || v.doc->error != csd_ok)
+        return csd_vnil;
+
+    /* containers are materialized into the document and freed with it */
+    csd_token vtoken = csd_lazy_seek(v.doc, v.offset, csd_value_mask | csd_item_mask);
+    if (!vtoken.ok)
+        return csd_vnil;
+    csd_queue_token(v.doc, vtoken);
+    csd_value value = csd_parse_value(v.doc, vtoken.type);
+    if (v.doc->error != csd_ok) {
+        csd_free_value(&value);
+        return csd_vnil;
+    }
+    return value;
+}
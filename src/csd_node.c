@@ -1,16 +1,90 @@
 #include "csd.h"
 #include <stdarg.h>
+#include <stdlib.h>
 
 #define STB_DS_IMPLEMENTATION
-#include "stb_ds.h"
+#include "csd_ds.h"
 
-void csd_free(csd_document *doc)
+/* containers of a document are in its arena, they grow there and are never freed alone */
+typedef struct csd_sequence_header
+{
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;
+    size_t slot_count;
+    csd_arena *arena;
+} csd_sequence_header;
+
+/* packed arrays hold int64_t or double items instead of values, nil is not packed */
+typedef struct csd_array_header
+{
+    size_t count;
+    size_t capacity;
+    csd_arena *arena;
+    csd_type packed;
+} csd_array_header;
+
+#define csd_sequence_header(s) ((csd_sequence_header *)(s)-1)
+#define csd_array_header(a) ((csd_array_header *)(a)-1)
+
+void csd_release_source(csd_document *doc);
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void *csd_mem_realloc(const csd_allocator *a, void *p, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+csd_arena *csd_arena_new(const csd_allocator *allocator);
+void *csd_arena_alloc(csd_arena *arena, size_t size);
+void csd_arena_reset(csd_arena *arena);
+void csd_arena_free(csd_arena **arena);
+csd_array csd_arena_array(csd_arena *arena, const csd_value *items, size_t count);
+csd_sequence csd_arena_sequence(csd_arena *arena, const csd_bucket *buckets,
+                                size_t count);
+
+/* null when out of memory, the document has failed then */
+csd_arena *csd_doc_arena(csd_document *doc)
+{
+    if (!doc->_arena && !(doc->_arena = csd_arena_new(doc->allocator)))
+        csd_memory_fail(doc);
+    return doc->_arena;
+}
+
+static void *csd_doc_alloc(csd_document *doc, size_t size)
 {
-    for (size_t i = 0; i < arrlen(doc->nodes); i++) {
-        csd_free_node(&doc->nodes[i]);
+    csd_arena *arena = csd_doc_arena(doc);
+    void *p = arena ? csd_arena_alloc(arena, size) : NULL;
+    if (!p)
+        csd_memory_fail(doc);
+    return p;
+}
+
+/* the arena is rewound, its largest chunk is kept for the next value */
+void csd_doc_reset(csd_document *doc)
+{
+    csd_arena_reset(doc->_arena);
+    doc->head = NULL;
+}
+
+/* releases everything but the reason, a failed document is returned that way */
+void csd_doc_release(csd_document *doc)
+{
+    /* a lazy document owns its scanner, it lives in the arena */
+    if (doc->_scanner) {
+        csd_index_free(&doc->_scanner->index);
+        csd_tape_free(&doc->_scanner->tape);
     }
-    arrfree(doc->nodes);
-    free(doc->source);
+    csd_arena_free(&doc->_arena);
+    doc->head = NULL;
+    doc->_scanner = NULL;
+    csd_release_source(doc);
+    doc->source = NULL;
+    doc->size = 0;
+    doc->_stream = NULL;
+}
+
+void csd_free(csd_document *doc)
+{
+    csd_doc_release(doc);
+    csd_mem_free(doc->allocator, doc->reason);
+    doc->reason = NULL;
 }
 
 void csd_free_node(csd_node *node)
@@ -29,18 +103,100 @@ void csd_free_value(csd_value *value)
     case csd_type_end:
         break;
     case csd_type_array:
-        arrfree(value->as_sequence);
+        if (value->as_array && !csd_array_header(value->as_array)->arena) {
+            for (size_t i = 0; i < csd_array_len(&value->as_array); i++)
+                csd_free_value(&value->as_array[i]);
+            csd_mem_free(NULL, csd_array_header(value->as_array));
+        }
+        value->as_array = NULL;
         break;
     case csd_type_sequence:
-        hmfree(value->as_array);
+        csd_sequence_free(&value->as_sequence);
         break;
     }
 }
 
+/*
+ * grows a container header and its elements, in the arena the old block is left behind.
+ * containers outside of a document have no allocator, they use the default one.
+ */
+static void *csd_container_grow(void *header, size_t used, size_t size, csd_arena *arena)
+{
+    if (!arena)
+        return csd_mem_realloc(NULL, header, size);
+    void *grown = csd_arena_alloc(arena, size);
+    if (grown && header)
+        memcpy(grown, header, used);
+    return grown;
+}
+
+static bool csd_arena_adopt(csd_arena *arena, csd_value *v);
+
+static bool csd_array_adopt(csd_arena *arena, csd_array *array)
+{
+    csd_array_header *header = *array ? csd_array_header(*array) : NULL;
+    if (header && header->arena)
+        return true;
+
+    size_t count = header ? header->count : 0;
+    csd_array adopted = csd_arena_array(arena, *array, count);
+    if (!adopted)
+        return false;
+    bool ok = true;
+    for (size_t i = 0; i < count; i++)
+        ok = csd_arena_adopt(arena, &adopted[i]) && ok;
+    csd_mem_free(NULL, header);
+    *array = adopted;
+    return ok;
+}
+
+static bool csd_sequence_adopt(csd_arena *arena, csd_sequence *sequence)
+{
+    csd_sequence_header *header = *sequence ? csd_sequence_header(*sequence) : NULL;
+    if (header && header->arena)
+        return true;
+
+    csd_sequence adopted =
+        csd_arena_sequence(arena, *sequence, header ? header->count : 0);
+    if (!adopted)
+        return false;
+    if (header)
+        csd_mem_free(NULL, header->slots);
+    csd_mem_free(NULL, header);
+    *sequence = adopted;
+    return true;
+}
+
+/* heap containers given to a document move into its arena, they stay out on failure */
+static bool csd_arena_adopt(csd_arena *arena, csd_value *v)
+{
+    if (v->type == csd_type_array)
+        return csd_array_adopt(arena, &v->as_array);
+    if (v->type == csd_type_sequence)
+        return csd_sequence_adopt(arena, &v->as_sequence);
+    return true;
+}
+
 csd_node *csd_doc_push(csd_document *doc, csd_node node)
 {
-    arrpush(doc->nodes, node);
-    return &arrlast(doc->nodes);
+    csd_node *n = csd_doc_alloc(doc, sizeof(csd_node));
+    if (!n)
+        return NULL;
+    n->key = node.key;
+    n->value = node.value;
+    if (!csd_arena_adopt(doc->_arena, &n->value))
+        csd_memory_fail(doc);
+    return n;
+}
+
+const char *csd_doc_strndup(csd_document *doc, const char *s, size_t size)
+{
+    char *copy = csd_doc_alloc(doc, size + 1);
+    if (!copy)
+        return NULL;
+    memcpy(copy, s, size);
+    copy[size] = '\0';
+    return copy;
 }
 
 csd_node *csd_new_nil(csd_document *doc, const char *name)
@@ -69,31 +225,202 @@ csd_node *csd_new_boolean(csd_document *doc, const char *name, bool v)
 }
 csd_node *csd_new_string(csd_document *doc, const char *name, const char *v)
 {
-    return csd_doc_push(doc, (csd_node){name, csd_vstring(v)});
+    csd_node node = {name, {.type = csd_type_string}};
+    size_t size = strlen(v);
+#ifndef csd_wide_values
+    if (size > csd_value_string_max) {
+        csd_fail(doc, csd_scan_error, "string of %zu bytes is too long for a value",
+                 size);
+        return NULL;
+    }
+#endif
+    csd_set_string(&node.value, (csd_string){v, size, false});
+    return csd_doc_push(doc, node);
+}
+
+uint32_t csd_hash(const char *s, size_t size)
+{
+    uint32_t hash = csd_hash_basis;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (uint8_t)s[i]) * csd_hash_prime;
+    return hash;
+}
+
+static void csd_sequence_slot(csd_sequence_header *header, uint32_t hash, size_t index)
+{
+    size_t mask = header->slot_count - 1;
+    size_t i = hash & mask;
+    while (header->slots[i])
+        i = (i + 1) & mask;
+    header->slots[i] = index + 1;
+}
+
+static void csd_sequence_slots(csd_sequence_header *header, size_t count)
+{
+    if (!header->arena)
+        csd_mem_free(NULL, header->slots);
+    header->slots = NULL;
+    header->slot_count = 0;
+    if (count <= csd_sequence_linear_max)
+        return;
+
+    header->slot_count = 2 * csd_sequence_linear_max;
+    while (header->slot_count < count * 2)
+        header->slot_count *= 2;
+    size_t size = header->slot_count * sizeof(uint32_t);
+    header->slots = header->arena ? csd_arena_alloc(header->arena, size)
+                                  : csd_mem_alloc(NULL, size);
+    /* without memory for the slots the keys are searched linearly */
+    if (!header->slots)
+        header->slot_count = 0;
+    else
+        memset(header->slots, 0, size);
+}
+
+static void csd_sequence_reindex(csd_sequence sequence)
+{
+    csd_sequence_header *header = csd_sequence_header(sequence);
+    csd_sequence_slots(header, header->count);
+    for (size_t i = 0; header->slots && i < header->count; i++)
+        csd_sequence_slot(header, sequence[i].hash, i);
+}
+
+static ptrdiff_t csd_sequence_find(csd_sequence sequence, const char *key, uint32_t hash)
+{
+    if (!sequence)
+        return -1;
+    csd_sequence_header *header = csd_sequence_header(sequence);
+
+    if (!header->slots) {
+        for (size_t i = 0; i < header->count; i++) {
+            if (sequence[i].hash == hash && strcmp(sequence[i].key, key) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    size_t mask = header->slot_count - 1;
+    for (size_t i = hash & mask; header->slots[i]; i = (i + 1) & mask) {
+        csd_bucket *bucket = &sequence[header->slots[i] - 1];
+        if (bucket->hash == hash && strcmp(bucket->key, key) == 0)
+            return header->slots[i] - 1;
+    }
+    return -1;
 }
 
 csd_node *csd_sequence_push(csd_sequence *sequence, csd_node *n)
 {
-    csd_bucket bucket = (csd_bucket){n->key, n};
-    return hmputs(*sequence, bucket), n;
+    return csd_sequence_push_hashed(sequence, n, csd_hash(n->key, strlen(n->key)));
+}
+
+csd_node *csd_sequence_push_hashed(csd_sequence *sequence, csd_node *n, uint32_t hash)
+{
+    csd_sequence_header *header = *sequence ? csd_sequence_header(*sequence) : NULL;
+    if (header && header->arena && !csd_arena_adopt(header->arena, &n->value))
+        return NULL;
+
+    ptrdiff_t found = csd_sequence_find(*sequence, n->key, hash);
+    if (found >= 0) {
+        (*sequence)[found] = (csd_bucket){n->key, hash, n};
+        return n;
+    }
+
+    if (!header || header->count == header->capacity) {
+        size_t capacity = header && header->capacity ? header->capacity * 2 : 4;
+        size_t used = header ? sizeof(*header) + header->count * sizeof(csd_bucket) : 0;
+        header = csd_container_grow(header, used,
+                                    sizeof(*header) + capacity * sizeof(csd_bucket),
+                                    header ? header->arena : NULL);
+        if (!header)
+            return NULL;
+        if (!*sequence)
+            *header = (csd_sequence_header){0};
+        header->capacity = capacity;
+        *sequence = (csd_sequence)(header + 1);
+    }
+
+    size_t index = header->count++;
+    (*sequence)[index] = (csd_bucket){n->key, hash, n};
+
+    if (header->count > csd_sequence_linear_max) {
+        if (header->count * 2 > header->slot_count)
+            csd_sequence_reindex(*sequence);
+        else
+            csd_sequence_slot(header, hash, index);
+    }
+    return n;
 }
 
 void csd_sequence_remove(csd_sequence *sequence, const char *key)
 {
-    hmdel(*sequence, key);
+    ptrdiff_t found = csd_sequence_find(*sequence, key, csd_hash(key, strlen(key)));
+    if (found < 0)
+        return;
+
+    csd_sequence_header *header = csd_sequence_header(*sequence);
+    memmove(&(*sequence)[found], &(*sequence)[found + 1],
+            (header->count - found - 1) * sizeof(csd_bucket));
+    header->count--;
+    if (header->slots)
+        csd_sequence_reindex(*sequence);
 }
 
 csd_node *csd_sequence_get(csd_sequence *sequence, const char *key)
 {
-    csd_bucket *bucket = hmgetp(*sequence, key);
-    if (!bucket)
+    return csd_sequence_get_hashed(sequence, key, csd_hash(key, strlen(key)));
+}
+
+csd_node *csd_sequence_get_hashed(csd_sequence *sequence, const char *key, uint32_t hash)
+{
+    ptrdiff_t found = csd_sequence_find(*sequence, key, hash);
+    if (found < 0)
         return NULL;
-    return bucket->value;
+    return (*sequence)[found].value;
 }
 
 size_t csd_sequence_count(csd_sequence *sequence)
 {
-    return hmlen(sequence);
+    return *sequence ? csd_sequence_header(*sequence)->count : 0;
+}
+
+void csd_sequence_free(csd_sequence *sequence)
+{
+    if (!*sequence)
+        return;
+    csd_sequence_header *header = csd_sequence_header(*sequence);
+    if (!header->arena) {
+        csd_mem_free(NULL, header->slots);
+        csd_mem_free(NULL, header);
+    }
+    *sequence = NULL;
+}
+
+/* parsed sequences are allocated once, at their final size */
+csd_sequence csd_arena_sequence(csd_arena *arena, const csd_bucket *buckets,
+                                size_t count)
+{
+    csd_sequence_header *header =
+        csd_arena_alloc(arena, sizeof(*header) + count * sizeof(csd_bucket));
+    if (!header)
+        return NULL;
+    *header = (csd_sequence_header){0, count, NULL, 0, arena};
+    csd_sequence sequence = (csd_sequence)(header + 1);
+    csd_sequence_slots(header, count);
+
+    /* a repeated key replaces the previous one, like a push would */
+    for (size_t i = 0; i < count; i++) {
+        const csd_bucket *bucket = &buckets[i];
+        ptrdiff_t found = csd_sequence_find(sequence, bucket->key, bucket->hash);
+        if (found >= 0) {
+            sequence[found] = *bucket;
+            continue;
+        }
+        sequence[header->count] = *bucket;
+        if (header->slots)
+            csd_sequence_slot(header, bucket->hash, header->count);
+        header->count++;
+    }
+    return sequence;
 }
 
 csd_node *csd_make_sequence_x(csd_document *doc, const char *name, ...)
@@ -103,24 +430,206 @@ csd_node *csd_make_sequence_x(csd_document *doc, const char *name, ...)
     va_list list;
     va_start(list, name);
 
+    /* out of memory, the document has failed and the node is null */
     node = csd_new_sequence(doc, name, NULL);
-    while ((child = va_arg(list, csd_node *))->value.type != csd_type_end) {
-        csd_insert(node, child);
+    while (node && (child = va_arg(list, csd_node *)) &&
+           child->value.type != csd_type_end) {
+        if (!csd_insert(node, child))
+            csd_memory_fail(doc);
     }
-    
+
     va_end(list);
     return node;
 }
 
+csd_string csd_doc_string(csd_document *doc, csd_string s)
+{
+    char *copy = csd_doc_alloc(doc, s.size + 1);
+    size_t size = s.size;
+
+    if (!copy)
+        return (csd_string){NULL, 0, false};
+    if (s.escaped)
+        size = csd_unescape(copy, s.data, s.size);
+    else
+        memcpy(copy, s.data, s.size);
+    copy[size] = '\0';
+    return (csd_string){copy, size, false};
+}
+
+csd_string csd_value_string(csd_document *doc, csd_value *value)
+{
+    csd_string s = csd_raw_string(value);
+    if (!s.escaped)
+        return s;
+
+    /* an inline string is decoded in the value, it never gets longer */
+    if (value->_inline) {
+        char decoded[csd_inline_string_max];
+        size_t size = csd_unescape(decoded, s.data, s.size);
+        csd_set_string(value, (csd_string){decoded, size, false});
+        return csd_raw_string(value);
+    }
+    /* out of memory, the document has failed and the string stays escaped */
+    csd_string decoded = csd_doc_string(doc, s);
+    if (!decoded.data)
+        return s;
+    csd_set_string(value, decoded);
+    return decoded;
+}
+
+/* an escaped string is decoded in a copy, which is owned by the caller */
+static bool csd_string_unescaped(csd_string s, csd_string *out, bool *owned)
+{
+    *out = s;
+    *owned = false;
+    if (!s.escaped)
+        return true;
+
+    char *decoded = csd_mem_alloc(NULL, s.size + 1);
+    if (!decoded)
+        return false;
+    *out = (csd_string){decoded, csd_unescape(decoded, s.data, s.size), false};
+    *owned = true;
+    return true;
+}
+
+/* without memory to decode an escaped string, the strings compare unequal */
+bool csd_string_eq(csd_string a, csd_string b)
+{
+    csd_string da, db;
+    bool owned_a, owned_b;
+    bool decoded = csd_string_unescaped(a, &da, &owned_a);
+    decoded = csd_string_unescaped(b, &db, &owned_b) && decoded;
+    bool eq = decoded && da.size == db.size && memcmp(da.data, db.data, da.size) == 0;
+
+    if (owned_a)
+        csd_mem_free(NULL, (char *)da.data);
+    if (owned_b)
+        csd_mem_free(NULL, (char *)db.data);
+    return eq;
+}
+
+/* packed arrays are in an arena, the tagged copy has room for a few pushes */
+static bool csd_array_unpack(csd_array *array)
+{
+    csd_array_header *packed = csd_array_header(*array);
+    size_t capacity = 2 * packed->count;
+    csd_array_header *header =
+        csd_arena_alloc(packed->arena, sizeof(*header) + capacity * sizeof(csd_value));
+    if (!header)
+        return false;
+    *header = (csd_array_header){packed->count, capacity, packed->arena, csd_type_nil};
+
+    csd_array unpacked = (csd_array)(header + 1);
+    for (size_t i = 0; i < packed->count; i++)
+        unpacked[i] = csd_array_at(array, i);
+    *array = unpacked;
+    return true;
+}
+
 csd_value *csd_array_push(csd_array *array, csd_value v)
 {
-    arrpush(*array, v);
-    return &arrlast(*array);
+    if (*array && csd_array_header(*array)->packed && !csd_array_unpack(array))
+        return NULL;
+
+    csd_array_header *header = *array ? csd_array_header(*array) : NULL;
+    if (header && header->arena && !csd_arena_adopt(header->arena, &v))
+        return NULL;
+
+    if (!header || header->count == header->capacity) {
+        size_t capacity = header && header->capacity ? header->capacity * 2 : 4;
+        size_t used = header ? sizeof(*header) + header->count * sizeof(csd_value) : 0;
+        header = csd_container_grow(header, used,
+                                    sizeof(*header) + capacity * sizeof(csd_value),
+                                    header ? header->arena : NULL);
+        if (!header)
+            return NULL;
+        if (!*array)
+            *header = (csd_array_header){0};
+        header->capacity = capacity;
+        *array = (csd_array)(header + 1);
+    }
+
+    (*array)[header->count] = v;
+    return &(*array)[header->count++];
 }
 
 size_t csd_array_len(csd_array *array)
 {
-    return arrlen(array);
+    return *array ? csd_array_header(*array)->count : 0;
+}
+
+csd_value csd_array_at(csd_array *array, size_t i)
+{
+    csd_type packed = csd_array_header(*array)->packed;
+    if (packed == csd_type_int)
+        return csd_vint(((int64_t *)*array)[i]);
+    if (packed == csd_type_float)
+        return csd_vfloat(((double *)*array)[i]);
+    return (*array)[i];
+}
+
+static void *csd_array_packed(csd_node *node, csd_type type, size_t *len)
+{
+    csd_array array = node->value.type == csd_type_array ? node->value.as_array : NULL;
+    if (!array || csd_array_header(array)->packed != type) {
+        *len = 0;
+        return NULL;
+    }
+    *len = csd_array_header(array)->count;
+    return array;
+}
+
+int64_t *csd_array_as_int64(csd_node *node, size_t *len)
+{
+    return csd_array_packed(node, csd_type_int, len);
+}
+
+double *csd_array_as_double(csd_node *node, size_t *len)
+{
+    return csd_array_packed(node, csd_type_float, len);
+}
+
+/* parsed arrays are allocated once, at their final size */
+csd_array csd_arena_array(csd_arena *arena, const csd_value *items, size_t count)
+{
+    csd_array_header *header =
+        csd_arena_alloc(arena, sizeof(*header) + count * sizeof(csd_value));
+    if (!header)
+        return NULL;
+    *header = (csd_array_header){count, count, arena, csd_type_nil};
+    if (count)
+        memcpy(header + 1, items, count * sizeof(csd_value));
+    return (csd_array)(header + 1);
+}
+
+/* packs the items if they are all ints or all floats, the first other one keeps values */
+csd_array csd_arena_pack(csd_arena *arena, const csd_value *items, size_t count)
+{
+    csd_type type = count ? items[0].type : csd_type_nil;
+    if (type != csd_type_int && type != csd_type_float)
+        return csd_arena_array(arena, items, count);
+    for (size_t i = 1; i < count; i++) {
+        if (items[i].type != type)
+            return csd_arena_array(arena, items, count);
+    }
+
+    csd_array_header *header =
+        csd_arena_alloc(arena, sizeof(*header) + count * sizeof(int64_t));
+    if (!header)
+        return NULL;
+    *header = (csd_array_header){count, count, arena, type};
+    if (type == csd_type_int) {
+        int64_t *ints = (int64_t *)(header + 1);
+        for (size_t i = 0; i < count; i++)
+            ints[i] = items[i].as_int;
+    } else {
+        double *floats = (double *)(header + 1);
+        for (size_t i = 0; i < count; i++)
+            floats[i] = items[i].as_float;
+    }
+    return (csd_array)(header + 1);
 }
 
 void csd_neq_none(csd_node *a, csd_node *b, void *data)
@@ -146,10 +655,12 @@ bool csd_value_eq(csd_node *a, csd_node *b, csd_value *va, csd_value *vb,
         csd_array via = va->as_array;
         csd_array vib = vb->as_array;
 
-        if (csd_len(a) != csd_len(b))
+        if (csd_array_len(&via) != csd_array_len(&vib))
             return_neq;
-        for (size_t i = 0; i < csd_len(a); i++) {
-            if (!csd_value_eq(a, b, &via[i], &vib[i], neq_cb, data))
+        for (size_t i = 0; i < csd_array_len(&via); i++) {
+            csd_value ia = csd_array_at(&via, i);
+            csd_value ib = csd_array_at(&vib, i);
+            if (!csd_value_eq(a, b, &ia, &ib, neq_cb, data))
                 return_neq;
         }
     } break;
@@ -158,9 +669,9 @@ bool csd_value_eq(csd_node *a, csd_node *b, csd_value *va, csd_value *vb,
         csd_sequence via = va->as_sequence;
         csd_sequence vib = vb->as_sequence;
 
-        if (csd_count(a) != csd_count(b))
+        if (csd_sequence_count(&via) != csd_sequence_count(&vib))
             return_neq;
-        for (size_t i = 0; i < csd_count(a); i++) {
+        for (size_t i = 0; i < csd_sequence_count(&via); i++) {
             if (!csd_eq_x((via[i].value), (vib[i].value), neq_cb, data))
                 return_neq;
         }
@@ -179,10 +690,16 @@ bool csd_value_eq(csd_node *a, csd_node *b, csd_value *va, csd_value *vb,
         if (va->as_boolean != vb->as_boolean)
             return_neq;
         break;
-    case csd_type_string:
-        if (strcmp(va->as_string, vb->as_string) != 0)
+    case csd_type_string: {
+        /* plain strings are compared in place, most short ones are inline */
+        csd_string sa = csd_raw_string(va), sb = csd_raw_string(vb);
+        if (sa.escaped || sb.escaped) {
+            if (!csd_string_eq(sa, sb))
+                return_neq;
+        } else if (sa.size != sb.size || memcmp(sa.data, sb.data, sa.size)) {
             return_neq;
-        break;
+        }
+    } break;
     }
     return true;
 }
@@ -192,7 +709,9 @@ bool csd_eq_x(csd_node *a, csd_node *b, csd_neq_cb neq_cb, void *data)
     if (!neq_cb)
         neq_cb = &csd_neq_none;
 
-    if ((a != NULL) ^ (b != NULL))
+    if (a == b)
+        return true;
+    if (!a || !b)
         return_neq;
     if (strcmp(a->key, b->key) != 0)
         return_neq;
@@ -0,0 +1,483 @@
+#include "csd.h"
+#include "csd_pow5.h"
+#include <stdlib.h>
+
+#define csd_float_max_digits 19
+#define csd_float_mantissa_bits 52
+#define csd_float_infinite_power 0x7ff
+
+static const double csd_exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+typedef struct csd_u128
+{
+    uint64_t high;
+    uint64_t low;
+} csd_u128;
+
+typedef struct csd_float_bits
+{
+    uint64_t mantissa;
+    int32_t power2;
+} csd_float_bits;
+
+static inline csd_u128 csd_mul128(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128)a * b;
+    return (csd_u128){(uint64_t)(r >> 64), (uint64_t)r};
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    return (csd_u128){hi_hi + (hi_lo >> 32) + (cross >> 32), cross << 32 | (uint32_t)lo_lo};
+#endif
+}
+
+static inline int csd_clz64(uint64_t bits)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(bits);
+#endif
+}
+
+bool csd_int_from_chars(const char *s, size_t size, int64_t *v)
+{
+    const char *it = s;
+    const char *end = s + size;
+    bool negative = false;
+    unsigned base = 10;
+    uint64_t magnitude = 0;
+
+    if (it < end && (*it == '-' || *it == '+'))
+        negative = *it++ == '-';
+    if (end - it > 2 && it[0] == '0' && (it[1] == 'x' || it[1] == 'X'))
+        base = 16, it += 2;
+    else if (end - it > 2 && it[0] == '0' && (it[1] == 'b' || it[1] == 'B'))
+        base = 2, it += 2;
+    if (it == end)
+        return false;
+
+    for (; it < end; it++) {
+        uint8_t digit = csd_digit_values[(uint8_t)*it];
+        if (digit >= base)
+            return false;
+        if (magnitude > (UINT64_MAX - digit) / base)
+            return false;
+        magnitude = magnitude * base + digit;
+    }
+
+    if (negative) {
+        if (magnitude > (uint64_t)INT64_MAX + 1)
+            return false;
+        *v = magnitude ? -(int64_t)(magnitude - 1) - 1 : 0;
+    } else {
+        if (magnitude > INT64_MAX)
+            return false;
+        *v = (int64_t)magnitude;
+    }
+    return true;
+}
+
+static csd_float_bits csd_eisel_lemire(int64_t q, uint64_t w)
+{
+    csd_float_bits answer = {0};
+
+    if (w == 0 || q < csd_pow5_min_exponent)
+        return answer;
+    if (q > csd_pow5_max_exponent) {
+        answer.power2 = csd_float_infinite_power;
+        return answer;
+    }
+
+    int lz = csd_clz64(w);
+    w <<= lz;
+
+    /* 52 explicit bits, the implicit bit, a rounding bit and a bit lost to upperbit */
+    const uint64_t precision_mask = UINT64_MAX >> (csd_float_mantissa_bits + 3);
+    size_t index = 2 * (size_t)(q - csd_pow5_min_exponent);
+    csd_u128 product = csd_mul128(w, csd_pow5[index]);
+    if ((product.high & precision_mask) == precision_mask) {
+        csd_u128 second = csd_mul128(w, csd_pow5[index + 1]);
+        product.low += second.high;
+        if (second.high > product.low)
+            product.high++;
+    }
+
+    int upperbit = (int)(product.high >> 63);
+    int shift = upperbit + 64 - csd_float_mantissa_bits - 3;
+    answer.mantissa = product.high >> shift;
+    answer.power2 = (int32_t)((((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023);
+
+    if (answer.power2 <= 0) {
+        if (-answer.power2 + 1 >= 64) {
+            answer = (csd_float_bits){0};
+            return answer;
+        }
+        answer.mantissa >>= -answer.power2 + 1;
+        answer.mantissa += answer.mantissa & 1;
+        answer.mantissa >>= 1;
+        answer.power2 = answer.mantissa < (1ull << csd_float_mantissa_bits) ? 0 : 1;
+        return answer;
+    }
+
+    /* exactly halfway between two floats: round to even instead of up */
+    if (product.low <= 1 && q >= -4 && q <= 23 && (answer.mantissa & 3) == 1 &&
+        answer.mantissa << shift == product.high) {
+        answer.mantissa &= ~1ull;
+    }
+
+    answer.mantissa += answer.mantissa & 1;
+    answer.mantissa >>= 1;
+    if (answer.mantissa >= (2ull << csd_float_mantissa_bits)) {
+        answer.mantissa = 1ull << csd_float_mantissa_bits;
+        answer.power2++;
+    }
+
+    answer.mantissa &= ~(1ull << csd_float_mantissa_bits);
+    if (answer.power2 >= csd_float_infinite_power) {
+        answer.power2 = csd_float_infinite_power;
+        answer.mantissa = 0;
+    }
+    return answer;
+}
+
+/* enough digits to round any double exactly, fewer are kept with the truncated flag */
+#define csd_decimal_max_digits 768
+#define csd_decimal_point_range 2047
+#define csd_decimal_max_shift 60
+
+typedef struct csd_decimal
+{
+    uint32_t count;
+    int32_t point;
+    bool truncated;
+    uint8_t digits[csd_decimal_max_digits];
+} csd_decimal;
+
+static void csd_decimal_trim(csd_decimal *d)
+{
+    while (d->count > 0 && d->digits[d->count - 1] == 0)
+        d->count--;
+}
+
+/* the digits are 0.d1d2d3... times 10^point */
+static bool csd_decimal_parse(const char *s, size_t size, csd_decimal *d, bool *negative)
+{
+    const char *it = s;
+    const char *end = s + size;
+    bool any = false;
+
+    *d = (csd_decimal){0};
+    if (it < end && (*it == '-' || *it == '+'))
+        *negative = *it++ == '-';
+
+    for (; it < end && (uint8_t)(*it - '0') < 10; it++) {
+        any = true;
+        if (d->count == 0 && *it == '0')
+            continue;
+        if (d->count < csd_decimal_max_digits)
+            d->digits[d->count++] = *it - '0';
+        else
+            d->truncated |= *it != '0';
+        d->point++;
+    }
+    if (it < end && *it == '.') {
+        for (it++; it < end && (uint8_t)(*it - '0') < 10; it++) {
+            any = true;
+            if (d->count == 0 && *it == '0') {
+                d->point--;
+                continue;
+            }
+            if (d->count < csd_decimal_max_digits)
+                d->digits[d->count++] = *it - '0';
+            else
+                d->truncated |= *it != '0';
+        }
+    }
+    if (!any)
+        return false;
+
+    if (it < end && (*it == 'e' || *it == 'E')) {
+        bool exp_negative = false;
+        int32_t exp = 0;
+
+        if (++it < end && (*it == '-' || *it == '+'))
+            exp_negative = *it++ == '-';
+        if (it == end || (uint8_t)(*it - '0') >= 10)
+            return false;
+        for (; it < end && (uint8_t)(*it - '0') < 10; it++) {
+            if (exp < 0x10000)
+                exp = exp * 10 + (*it - '0');
+        }
+        d->point += exp_negative ? -exp : exp;
+    }
+    csd_decimal_trim(d);
+    return it == end;
+}
+
+/* divides by 2^shift, the digits are rewritten from the most significant one */
+static void csd_decimal_right_shift(csd_decimal *d, uint32_t shift)
+{
+    uint32_t read = 0, write = 0;
+    uint64_t n = 0;
+    const uint64_t mask = (1ull << shift) - 1;
+
+    while ((n >> shift) == 0) {
+        if (read < d->count) {
+            n = 10 * n + d->digits[read++];
+        } else if (n == 0) {
+            return;
+        } else {
+            while ((n >> shift) == 0) {
+                n *= 10;
+                read++;
+            }
+            break;
+        }
+    }
+
+    d->point -= (int32_t)read - 1;
+    if (d->point < -csd_decimal_point_range) {
+        *d = (csd_decimal){0};
+        return;
+    }
+    while (read < d->count) {
+        uint8_t digit = (uint8_t)(n >> shift);
+        n = 10 * (n & mask) + d->digits[read++];
+        d->digits[write++] = digit;
+    }
+    while (n > 0) {
+        uint8_t digit = (uint8_t)(n >> shift);
+        n = 10 * (n & mask);
+        if (write < csd_decimal_max_digits)
+            d->digits[write++] = digit;
+        else
+            d->truncated |= digit != 0;
+    }
+    d->count = write;
+    csd_decimal_trim(d);
+}
+
+/* multiplies by 2^shift, from the least significant digit into a scratch of carries */
+static void csd_decimal_left_shift(csd_decimal *d, uint32_t shift)
+{
+    uint8_t scratch[csd_decimal_max_digits + 20];
+    size_t at = sizeof(scratch);
+    uint64_t n = 0;
+
+    for (uint32_t i = d->count; i > 0; i--) {
+        n += (uint64_t)d->digits[i - 1] << shift;
+        scratch[--at] = n % 10;
+        n /= 10;
+    }
+    for (; n > 0; n /= 10)
+        scratch[--at] = n % 10;
+
+    size_t count = sizeof(scratch) - at;
+    d->point += (int32_t)(count - d->count);
+    if (count > csd_decimal_max_digits) {
+        for (size_t i = csd_decimal_max_digits; i < count; i++)
+            d->truncated |= scratch[at + i] != 0;
+        count = csd_decimal_max_digits;
+    }
+    memcpy(d->digits, &scratch[at], count);
+    d->count = (uint32_t)count;
+    csd_decimal_trim(d);
+}
+
+/* the integer part, rounded half to even */
+static uint64_t csd_decimal_round(const csd_decimal *d)
+{
+    if (d->count == 0 || d->point < 0)
+        return 0;
+    if (d->point > 18)
+        return UINT64_MAX;
+
+    uint32_t point = (uint32_t)d->point;
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < point; i++)
+        n = 10 * n + (i < d->count ? d->digits[i] : 0);
+
+    bool up = false;
+    if (point < d->count) {
+        up = d->digits[point] >= 5;
+        if (d->digits[point] == 5 && point + 1 == d->count)
+            up = d->truncated || (point > 0 && (d->digits[point - 1] & 1));
+    }
+    return n + up;
+}
+
+static uint32_t csd_decimal_shift(int32_t n)
+{
+    static const uint8_t shifts[] = {0,  3,  6,  9,  13, 16, 19, 23, 26, 29,
+                                     33, 36, 39, 43, 46, 49, 53, 56, 59};
+    return n < (int32_t)csd_array_sizeof(shifts) ? shifts[n] : csd_decimal_max_shift;
+}
+
+/*
+ * exact decimal to binary conversion for what Eisel-Lemire can not round, the number is
+ * shifted by powers of two into [1/2, 1) then scaled to 53 bits, see Nigel Tao's
+ * "simple decimal conversion".
+ */
+static bool csd_float_from_chars_slow(const char *s, size_t size, double *v)
+{
+    const int32_t min_exponent = -1023;
+    csd_decimal d;
+    bool negative = false;
+    int32_t exp2 = 0;
+    uint64_t mantissa = 0;
+    int32_t power2 = 0;
+
+    if (!csd_decimal_parse(s, size, &d, &negative))
+        return false;
+    if (d.count == 0 || d.point < -324)
+        goto done;
+    if (d.point >= 310)
+        return false;
+
+    while (d.point > 0) {
+        uint32_t shift = csd_decimal_shift(d.point);
+        csd_decimal_right_shift(&d, shift);
+        if (d.point < -csd_decimal_point_range)
+            goto done;
+        exp2 += shift;
+    }
+    while (d.point <= 0) {
+        uint32_t shift;
+        if (d.point == 0) {
+            if (d.digits[0] >= 5)
+                break;
+            shift = d.digits[0] < 2 ? 2 : 1;
+        } else {
+            shift = csd_decimal_shift(-d.point);
+        }
+        csd_decimal_left_shift(&d, shift);
+        if (d.point > csd_decimal_point_range)
+            return false;
+        exp2 -= shift;
+    }
+
+    /* [1/2, 1) to the [1, 2) of the binary format, subnormals are shifted further */
+    exp2--;
+    while (min_exponent + 1 > exp2) {
+        uint32_t shift = (uint32_t)(min_exponent + 1 - exp2);
+        shift = shift > csd_decimal_max_shift ? csd_decimal_max_shift : shift;
+        csd_decimal_right_shift(&d, shift);
+        exp2 += shift;
+    }
+    if (exp2 - min_exponent >= csd_float_infinite_power)
+        return false;
+
+    csd_decimal_left_shift(&d, csd_float_mantissa_bits + 1);
+    mantissa = csd_decimal_round(&d);
+    if (mantissa >= 2ull << csd_float_mantissa_bits) {
+        csd_decimal_right_shift(&d, 1);
+        exp2++;
+        mantissa = csd_decimal_round(&d);
+        if (exp2 - min_exponent >= csd_float_infinite_power)
+            return false;
+    }
+    power2 = exp2 - min_exponent;
+    if (mantissa < 1ull << csd_float_mantissa_bits)
+        power2--;
+    mantissa &= (1ull << csd_float_mantissa_bits) - 1;
+
+done:;
+    uint64_t raw = mantissa | (uint64_t)power2 << csd_float_mantissa_bits |
+                   (uint64_t)negative << 63;
+    memcpy(v, &raw, sizeof(*v));
+    return true;
+}
+
+bool csd_float_from_chars(const char *s, size_t size, double *v)
+{
+    const char *it = s;
+    const char *end = s + size;
+    bool negative = false;
+    bool truncated = false;
+    uint64_t w = 0;
+    int64_t q = 0;
+    int digits = 0;
+
+    if (it < end && (*it == '-' || *it == '+'))
+        negative = *it++ == '-';
+    const char *first = it;
+
+    for (; it < end && (uint8_t)(*it - '0') < 10; it++) {
+        uint8_t digit = *it - '0';
+        if (digits < csd_float_max_digits) {
+            w = w * 10 + digit;
+            digits += w != 0;
+        } else {
+            truncated |= digit != 0;
+            q++;
+        }
+    }
+    bool point = it < end && *it == '.';
+    if (point) {
+        for (it++; it < end && (uint8_t)(*it - '0') < 10; it++) {
+            uint8_t digit = *it - '0';
+            if (digits < csd_float_max_digits) {
+                w = w * 10 + digit;
+                digits += w != 0;
+                q--;
+            } else {
+                truncated |= digit != 0;
+            }
+        }
+    }
+    if (it - first == point)
+        return false;
+    if (it < end && (*it == 'e' || *it == 'E')) {
+        bool exp_negative = false;
+        int64_t exp = 0;
+
+        it++;
+        if (it < end && (*it == '-' || *it == '+'))
+            exp_negative = *it++ == '-';
+        if (it == end || (uint8_t)(*it - '0') >= 10)
+            return false;
+        for (; it < end && (uint8_t)(*it - '0') < 10; it++) {
+            if (exp < 0x10000)
+                exp = exp * 10 + (*it - '0');
+        }
+        q += exp_negative ? -exp : exp;
+    }
+    if (it != end)
+        return csd_float_from_chars_slow(s, size, v);
+
+    if (w == 0) {
+        *v = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    if (!truncated && q >= -22 && q <= 22 && w <= 1ull << 53) {
+        double d = (double)w;
+        d = q < 0 ? d / csd_exact_pow10[-q] : d * csd_exact_pow10[q];
+        *v = negative ? -d : d;
+        return true;
+    }
+
+    csd_float_bits bits = csd_eisel_lemire(q, w);
+    if (truncated) {
+        csd_float_bits upper = csd_eisel_lemire(q, w + 1);
+        if (upper.mantissa != bits.mantissa || upper.power2 != bits.power2)
+            return csd_float_from_chars_slow(s, size, v);
+    }
+    if (bits.power2 == csd_float_infinite_power)
+        return false;
+
+    uint64_t raw = bits.mantissa | (uint64_t)bits.power2 << csd_float_mantissa_bits |
+                   (uint64_t)negative << 63;
+    memcpy(v, &raw, sizeof(*v));
+    return true;
+}
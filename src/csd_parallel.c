@@ -0,0 +1,484 @@
+#include "csd.h"
+#include "csd_ds.h"
+#include <stdlib.h>
+
+extern csd_token_mask csd_value_mask;
+extern csd_token_mask csd_item_mask;
+
+csd_token csd_expect(csd_document *doc, csd_token_mask mask);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_token csd_queue_token(csd_document *doc, csd_token token);
+csd_node *csd_parse_node(csd_document *doc, uint32_t *hash);
+csd_value csd_parse_value(csd_document *doc, csd_token_mask mask);
+size_t csd_stream_at(csd_document *doc);
+const char *csd_doc_strndup(csd_document *doc, const char *s, size_t size);
+void csd_doc_reset(csd_document *doc);
+csd_arena *csd_doc_arena(csd_document *doc);
+const csd_allocator *csd_ds_use(const csd_allocator *allocator);
+void csd_arena_chain(csd_arena *arena, csd_arena *from);
+csd_array csd_arena_array(csd_arena *arena, const csd_value *items, size_t count);
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+csd_array csd_arena_pack(csd_arena *arena, const csd_value *items, size_t count);
+csd_sequence csd_arena_sequence(csd_arena *arena, const csd_bucket *buckets,
+                                size_t count);
+
+typedef struct csd_pool_worker csd_pool_worker;
+typedef void (*csd_pool_fn)(void *arg, csd_pool_worker *worker);
+void csd_pool_run(csd_pool *pool, csd_pool_fn fn, void *arg);
+
+typedef enum csd_split_state
+{
+    csd_split_code,
+    csd_split_single_quote,
+    csd_split_double_quote,
+    csd_split_comment,
+    csd_split_state_count,
+} csd_split_state;
+
+typedef struct csd_split
+{
+    csd_split_state state;
+    int64_t depth;
+} csd_split;
+
+typedef struct csd_chunk
+{
+    csd_document doc;
+    csd_scanner scanner;
+    size_t begin;
+    size_t end;
+    size_t block_begin;
+    size_t block_end;
+    csd_split start;
+    csd_split speculated;
+    bool after_close;
+    bool closed;
+} csd_chunk;
+
+typedef struct csd_parallel
+{
+    csd_document *doc;
+    csd_chunk *chunks;
+    int count;
+    bool sequence;
+    csd_pool *pool;
+} csd_parallel;
+
+typedef void (*csd_chunk_fn)(csd_parallel *par, csd_chunk *chunk);
+
+typedef struct csd_phase
+{
+    csd_parallel *par;
+    csd_chunk_fn fn;
+    int next;
+} csd_phase;
+
+/* workers take the next chunk until the phase runs out */
+static void csd_phase_run(void *arg, csd_pool_worker *worker)
+{
+    csd_phase *phase = arg;
+    (void)worker;
+
+    while (1) {
+        int k = __atomic_fetch_add(&phase->next, 1, __ATOMIC_RELAXED);
+        if (k >= phase->par->count)
+            break;
+        phase->fn(phase->par, &phase->par->chunks[k]);
+    }
+}
+
+/* runs fn on every chunk, on the pool threads or on the calling thread without one */
+static void csd_parallel_run(csd_parallel *par, csd_chunk_fn fn)
+{
+    csd_phase phase = {par, fn, 0};
+    if (par->pool)
+        csd_pool_run(par->pool, csd_phase_run, &phase);
+    else
+        csd_phase_run(&phase, NULL);
+}
+
+/*
+ * walks [at, end) from a known lexical state, following strings, comments and depth.
+ * with a boundary, it stops past the first separator between two root elements.
+ */
+static size_t csd_split_walk(csd_parallel *par, size_t at, size_t end, csd_split *split,
+                             bool boundary, bool *after_close)
+{
+    csd_index *index = &par->doc->_scanner->index;
+    const char *source = par->doc->source;
+    const char quotes[] = {
+        [csd_split_single_quote] = '\'',
+        [csd_split_double_quote] = '"',
+    };
+
+    while (at < end) {
+        switch (split->state) {
+        case csd_split_code: {
+            at = csd_index_next(index, at, csd_index_structural | csd_index_quote);
+            if (at >= end)
+                return end;
+
+            char c = source[at++];
+            if (c == '{' || c == '[') {
+                split->depth++;
+            } else if (c == '}' || c == ']') {
+                split->depth--;
+                /* a nested sequence closes itself, the next element may follow it */
+                if (boundary && split->depth == 1 && c == '}' && par->sequence) {
+                    *after_close = true;
+                    return at;
+                }
+                if (boundary && split->depth <= 0)
+                    return end;
+            } else if (c == ',') {
+                if (boundary && split->depth == 1) {
+                    *after_close = false;
+                    return at;
+                }
+            } else if (c == '#') {
+                split->state = csd_split_comment;
+            } else if (c == '\'') {
+                split->state = csd_split_single_quote;
+            } else if (c == '"') {
+                split->state = csd_split_double_quote;
+            }
+        } break;
+
+        case csd_split_single_quote:
+        case csd_split_double_quote:
+            at = csd_index_next(index, at, csd_index_quote | csd_index_backslash);
+            if (at >= end)
+                return end;
+            if (source[at] == '\\')
+                at += 2;
+            else if (source[at++] == quotes[split->state])
+                split->state = csd_split_code;
+            break;
+
+        case csd_split_comment: {
+            const char *newline = memchr(&source[at], '\n', end - at);
+            if (!newline)
+                return end;
+            at = newline - source + 1;
+            split->state = csd_split_code;
+        } break;
+
+        case csd_split_state_count:
+            break;
+        }
+    }
+    return end;
+}
+
+static void csd_chunk_classify(csd_parallel *par, csd_chunk *chunk)
+{
+    csd_index_fill(&par->doc->_scanner->index, par->doc->source, chunk->block_begin,
+                   chunk->block_end);
+}
+
+/* chunks start on a new line, they are walked as if outside of any string or comment */
+static void csd_chunk_speculate(csd_parallel *par, csd_chunk *chunk)
+{
+    chunk->speculated = (csd_split){csd_split_code, 0};
+    csd_split_walk(par, chunk->begin, chunk->end, &chunk->speculated, false, NULL);
+}
+
+static void csd_chunk_sequence(csd_chunk *chunk)
+{
+    csd_document *doc = &chunk->doc;
+    if (chunk->after_close)
+        csd_read(doc, csd_token_comma);
+
+    while (csd_stream_at(doc) < chunk->end) {
+        if (csd_read(doc, csd_token_scope_end).ok) {
+            chunk->closed = true;
+            break;
+        }
+        uint32_t hash;
+        csd_node *node = csd_parse_node(doc, &hash);
+        if (!node)
+            break;
+        /* the node is in the arena, so it exists */
+        csd_arena *arena = doc->_arena;
+        if (!csd_ds_reserve(arena->buckets, arrlen(arena->buckets) + 1)) {
+            csd_memory_fail(doc);
+            break;
+        }
+        arrpush(arena->buckets, ((csd_bucket){node->key, hash, node}));
+
+        bool nested = node->value.type == csd_type_sequence;
+        if (nested && csd_stream_at(doc) >= chunk->end)
+            break;
+
+        csd_token_mask separator = csd_token_scope_end | csd_token_comma;
+        if (nested)
+            separator |= csd_token_id | csd_token_scope_begin;
+
+        csd_token token = csd_expect(doc, separator);
+        if (!token.ok)
+            break;
+        if (token.type & csd_token_scope_end) {
+            chunk->closed = true;
+            break;
+        }
+        if (token.type & (csd_token_id | csd_token_scope_begin))
+            csd_queue_token(doc, token);
+    }
+}
+
+static void csd_chunk_array(csd_chunk *chunk)
+{
+    csd_document *doc = &chunk->doc;
+
+    while (csd_stream_at(doc) < chunk->end) {
+        if (csd_read(doc, csd_token_array_end).ok) {
+            chunk->closed = true;
+            break;
+        }
+        csd_value value = csd_parse_value(doc, csd_item_mask);
+        csd_arena *arena = csd_doc_arena(doc);
+        if (!arena || !csd_ds_reserve(arena->items, arrlen(arena->items) + 1)) {
+            csd_memory_fail(doc);
+            break;
+        }
+        arrpush(arena->items, value);
+        csd_token token = csd_expect(doc, csd_token_array_end | csd_token_comma);
+        if (!token.ok)
+            break;
+        if (token.type & csd_token_array_end) {
+            chunk->closed = true;
+            break;
+        }
+    }
+}
+
+static void csd_chunk_parse(csd_parallel *par, csd_chunk *chunk)
+{
+    csd_document *doc = &chunk->doc;
+    *doc = (csd_document){0};
+    doc->source = par->doc->source;
+    doc->size = par->doc->size;
+    doc->allocator = par->doc->allocator;
+    doc->_stream = &doc->source[chunk->begin];
+    /* the index is shared, every chunk reads it from its own position */
+    chunk->scanner = (csd_scanner){.index = par->doc->_scanner->index};
+    doc->_scanner = &chunk->scanner;
+    /* chunk elements are nested in the root container */
+    doc->_depth = 1;
+    doc->_max_depth = par->doc->_max_depth;
+    doc->_packed_arrays = par->doc->_packed_arrays;
+    /* chunks never write to the source, a failed parse can be retried sequentially */
+    doc->_source_kind = csd_source_borrowed;
+
+    /* elements wait in the chunk arena scratch, the root is built from every chunk */
+    const csd_allocator *previous = csd_ds_use(doc->allocator);
+    if (chunk->begin < chunk->end) {
+        if (par->sequence)
+            csd_chunk_sequence(chunk);
+        else
+            csd_chunk_array(chunk);
+    }
+    csd_ds_use(previous);
+}
+
+static void csd_chunk_free(csd_chunk *chunk)
+{
+    chunk->scanner.index = (csd_index){0};
+    csd_free(&chunk->doc);
+}
+
+/* finds the chunk boundaries, a prefix pass resolves the state each chunk starts in */
+static void csd_parallel_split(csd_parallel *par, size_t begin)
+{
+    csd_document *doc = par->doc;
+    csd_split split = {csd_split_code, 1};
+
+    for (int k = 0; k < par->count; k++) {
+        csd_chunk *chunk = &par->chunks[k];
+        csd_split end = chunk->speculated;
+        chunk->start = split;
+
+        /* a chunk starting inside a string or comment is walked again, serially */
+        if (split.state != csd_split_code) {
+            end = (csd_split){split.state, 0};
+            csd_split_walk(par, chunk->begin, chunk->end, &end, false, NULL);
+        }
+        split = (csd_split){end.state, split.depth + end.depth};
+    }
+
+    par->chunks[0].begin = begin;
+    for (int k = 1; k < par->count; k++) {
+        csd_chunk *chunk = &par->chunks[k];
+        split = chunk->start;
+        size_t at = csd_split_walk(par, chunk->begin, doc->size, &split, true,
+                                   &chunk->after_close);
+        chunk->begin = at > par->chunks[k - 1].begin ? at : par->chunks[k - 1].begin;
+        par->chunks[k - 1].end = chunk->begin;
+    }
+    par->chunks[par->count - 1].end = doc->size;
+}
+
+static bool csd_parallel_stitch(csd_parallel *par, csd_node *root)
+{
+    csd_document *doc = par->doc;
+    int last = 0;
+
+    for (int k = 0; k < par->count; k++) {
+        csd_chunk *chunk = &par->chunks[k];
+        if (chunk->doc.error != csd_ok)
+            return false;
+        if (chunk->begin < chunk->end)
+            last = k;
+    }
+    for (int k = 0; k < par->count; k++) {
+        if (par->chunks[k].closed != (k == last))
+            return false;
+    }
+
+    /* the elements are gathered in the arena scratch, the root is allocated once */
+    csd_arena *arena = csd_doc_arena(doc);
+    size_t base = par->sequence ? arrlen(arena->buckets) : arrlen(arena->items);
+    size_t total = base;
+    for (int k = 0; k < par->count; k++) {
+        csd_arena *from = par->chunks[k].doc._arena;
+        if (from)
+            total += par->sequence ? arrlen(from->buckets) : arrlen(from->items);
+    }
+    bool reserved = par->sequence ? csd_ds_reserve(arena->buckets, total)
+                                  : csd_ds_reserve(arena->items, total);
+    if (!reserved) {
+        csd_memory_fail(doc);
+        return false;
+    }
+    for (int k = 0; k < par->count; k++) {
+        csd_arena *from = par->chunks[k].doc._arena;
+        if (!from)
+            continue;
+        if (par->sequence) {
+            size_t count = arrlen(from->buckets);
+            if (count)
+                memcpy(arraddnptr(arena->buckets, count), from->buckets,
+                       count * sizeof(csd_bucket));
+        } else {
+            size_t count = arrlen(from->items);
+            if (count)
+                memcpy(arraddnptr(arena->items, count), from->items,
+                       count * sizeof(csd_value));
+        }
+    }
+    if (par->sequence) {
+        csd_bucket *buckets = &arena->buckets[base];
+        size_t count = arrlen(arena->buckets) - base;
+        root->value = csd_vsequence(csd_arena_sequence(arena, buckets, count));
+        arrsetlen(arena->buckets, base);
+    } else {
+        csd_value *items = &arena->items[base];
+        size_t count = arrlen(arena->items) - base;
+        csd_array array = doc->_packed_arrays ? csd_arena_pack(arena, items, count)
+                                              : csd_arena_array(arena, items, count);
+        root->value = csd_varray(array);
+        arrsetlen(arena->items, base);
+    }
+    if (par->sequence ? !root->value.as_sequence : !root->value.as_array) {
+        csd_memory_fail(doc);
+        return false;
+    }
+
+    /* the elements stay in the chunk arenas, which the document now owns */
+    for (int k = 0; k < par->count; k++) {
+        csd_arena *from = par->chunks[k].doc._arena;
+        if (from) {
+            arrfree(from->items);
+            arrfree(from->buckets);
+        }
+        csd_arena_chain(arena, from);
+        par->chunks[k].doc._arena = NULL;
+    }
+    return true;
+}
+
+/* the source is split in chunks, the pool threads run every phase */
+csd_node *csd_parse_parallel(csd_document *doc, int chunks, csd_pool *pool)
+{
+    csd_parallel par = {.doc = doc};
+    size_t blocks;
+
+    par.count = chunks < csd_parallel_max_threads ? chunks : csd_parallel_max_threads;
+    if (par.count > 0 && (size_t)par.count > doc->size / csd_parallel_min_chunk)
+        par.count = (int)(doc->size / csd_parallel_min_chunk);
+    if (par.count < 1)
+        par.count = 1;
+    par.pool = pool;
+
+    par.chunks = csd_mem_alloc(doc->allocator, par.count * sizeof(csd_chunk));
+    if (!par.chunks || !csd_index_reserve(&doc->_scanner->index, doc->size)) {
+        csd_memory_fail(doc);
+        csd_mem_free(doc->allocator, par.chunks);
+        return NULL;
+    }
+    memset(par.chunks, 0, par.count * sizeof(csd_chunk));
+    blocks = doc->_scanner->index.count;
+    for (int k = 0; k < par.count; k++) {
+        par.chunks[k].block_begin = blocks * k / par.count;
+        par.chunks[k].block_end = blocks * (k + 1) / par.count;
+    }
+    csd_parallel_run(&par, &csd_chunk_classify);
+
+    /* only a root sequence or array is split, its elements are parsed in parallel */
+    csd_node *root = NULL;
+    if (!csd_read(doc, csd_token_eof).ok) {
+        csd_token key = csd_expect(doc, csd_token_id | csd_token_scope_begin);
+        csd_token vtoken = key;
+        if (key.ok && key.type == csd_token_id) {
+            vtoken = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
+            if (vtoken.ok && vtoken.type == csd_token_assign)
+                vtoken = csd_read(doc, csd_token_scope_begin | csd_token_array_begin);
+        }
+        if (vtoken.ok && par.count > 1) {
+            root = csd_new_nil(doc, key.type == csd_token_id
+                                        ? csd_doc_strndup(doc, key.expr, key.size)
+                                        : "");
+            par.sequence = vtoken.type == csd_token_scope_begin;
+        }
+    }
+
+    if (root) {
+        size_t begin = csd_stream_at(doc);
+        par.chunks[0].begin = begin;
+        for (int k = 1; k < par.count; k++) {
+            size_t at = begin + (doc->size - begin) * k / par.count;
+            size_t next = begin + (doc->size - begin) * (k + 1) / par.count;
+            const char *newline = memchr(&doc->source[at], '\n', next - at);
+
+            /* splits land on a new line, and never on an escaped character */
+            at = newline ? (size_t)(newline - doc->source) + 1 : at;
+            while (at < doc->size && doc->source[at - 1] == '\\')
+                at++;
+            par.chunks[k].begin = at;
+            par.chunks[k - 1].end = at;
+        }
+        par.chunks[par.count - 1].end = doc->size;
+
+        csd_parallel_run(&par, &csd_chunk_speculate);
+        csd_parallel_split(&par, begin);
+        csd_parallel_run(&par, &csd_chunk_parse);
+
+        if (!csd_parallel_stitch(&par, root)) {
+            csd_doc_reset(doc);
+            root = NULL;
+        }
+        for (int k = 0; k < par.count; k++)
+            csd_chunk_free(&par.chunks[k]);
+    }
+    csd_mem_free(doc->allocator, par.chunks);
+
+    /* small or scalar roots, and malformed documents, take the sequential path */
+    if (!root && doc->error == csd_ok) {
+        doc->_stream = doc->source;
+        doc->_scanner->has_queued_token = false;
+        if (!csd_read(doc, csd_token_eof).ok)
+            root = csd_parse_node(doc, NULL);
+    }
+    return root;
+}
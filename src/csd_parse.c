@@ -1,5 +1,5 @@
 #include "csd.h"
-#include "stb_ds.h"
+#include "csd_ds.h"
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -9,79 +9,293 @@
 #include <unistd.h>
 #endif
 
-csd_token_mask csd_value_mask = csd_token_string | csd_token_float | csd_token_int |
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define csd_has_mmap 1
+#endif
+
+#ifdef MAP_POPULATE
+#define csd_map_flags (MAP_PRIVATE | MAP_POPULATE)
+#else
+#define csd_map_flags MAP_PRIVATE
+#endif
+
+#define csd_int_mask (csd_token_int | csd_token_int_hex | csd_token_int_binary)
+
+csd_token_mask csd_value_mask = csd_token_string | csd_token_float | csd_int_mask |
                                 csd_token_true | csd_token_false | csd_token_array_begin;
 
-csd_token_mask csd_item_mask = csd_token_string | csd_token_float | csd_token_int |
+csd_token_mask csd_item_mask = csd_token_string | csd_token_float | csd_int_mask |
                                csd_token_true | csd_token_false | csd_token_scope_begin |
                                csd_token_array_begin;
 
-csd_node *csd_parse_node(csd_document *doc);
-csd_sequence csd_parse_sequence(csd_document *doc);
+static csd_document csd_parse_buffer(char *source, size_t size, csd_parse_options options,
+                                     csd_source_kind kind);
+csd_node *csd_parse_node(csd_document *doc, uint32_t *hash);
+const char *csd_doc_strndup(csd_document *doc, const char *s, size_t size);
+void csd_doc_release(csd_document *doc);
+csd_arena *csd_doc_arena(csd_document *doc);
+csd_array csd_arena_array(csd_arena *arena, const csd_value *items, size_t count);
+csd_array csd_arena_pack(csd_arena *arena, const csd_value *items, size_t count);
+csd_sequence csd_arena_sequence(csd_arena *arena, const csd_bucket *buckets,
+                                size_t count);
 csd_value csd_parse_value(csd_document *doc, csd_token_mask mask);
+csd_node *csd_parse_parallel(csd_document *doc, int chunks, csd_pool *pool);
+csd_pool *csd_pool_shared(void);
+bool csd_pool_nested(csd_pool *pool);
+csd_value csd_token_value(csd_document *doc, csd_token vtoken);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
 const char *csd_token_typename(csd_token_type type);
 char *csd_get_filename(char *s, FILE *f);
+char *csd_load_file(csd_document *doc, const char *path, size_t *size,
+                    csd_source_kind *kind);
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void *csd_mem_realloc(const csd_allocator *a, void *p, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+const csd_allocator *csd_ds_use(const csd_allocator *allocator);
+
+/* a read or allocation failure fails the document */
+static char *csd_read_stream(csd_document *doc, FILE *f, size_t size_hint, size_t *size,
+                             const char *filename)
+{
+    const csd_allocator *a = doc->allocator;
+    size_t capacity = size_hint + 1 > 4096 ? size_hint + 1 : 4096;
+    size_t length = 0;
+    size_t count;
+    char *source = csd_mem_alloc(a, capacity);
+    if (!source) {
+        csd_memory_fail(doc);
+        return NULL;
+    }
+
+    while ((count = fread(&source[length], 1, capacity - length, f)) > 0) {
+        length += count;
+        if (length < capacity)
+            continue;
+        char *grown = csd_mem_realloc(a, source, capacity * 2);
+        if (!grown) {
+            csd_mem_free(a, source);
+            csd_memory_fail(doc);
+            return NULL;
+        }
+        source = grown;
+        capacity *= 2;
+    }
+    if (ferror(f)) {
+        csd_file_fail(doc, filename, "%s", strerror(errno));
+        csd_mem_free(a, source);
+        return NULL;
+    }
+
+    *size = length;
+    return source;
+}
 
 csd_document csd_parse_stream(FILE *f)
+{
+    return csd_parse_stream_x(f, csd_parse_standard);
+}
+
+csd_document csd_parse_stream_x(FILE *f, csd_parse_options options)
 {
     char filename[255];
-    csd_document doc = {0};
+    csd_document doc = {.allocator = options.allocator};
     csd_get_filename(filename, f);
-    doc.error = setjmp(doc._throw_env);
 
-    if (doc.error != csd_ok) {
-        csd_free(&doc);
+    if (!f || ferror(f)) {
+        csd_file_fail(&doc, filename, "%s", f ? strerror(errno) : "no stream");
         return doc;
     }
-    if (ferror(f)) {
-        csd_file_throw(&doc, filename, "%s", strerror(errno));
+
+    size_t size;
+    char *source = csd_read_stream(&doc, f, 0, &size, filename);
+    if (!source)
+        return doc;
+    return csd_parse_buffer(source, size, options, csd_source_owned);
+}
+
+csd_document csd_parse_file(const char *path)
+{
+    return csd_parse_file_x(path, csd_parse_standard);
+}
+
+csd_document csd_parse_file_x(const char *path, csd_parse_options options)
+{
+    csd_document doc = {.allocator = options.allocator};
+    size_t size;
+    csd_source_kind kind;
+    char *source = csd_load_file(&doc, path, &size, &kind);
+
+    if (!source) {
+        return doc;
+    }
+    return csd_parse_buffer(source, size, options, kind);
+}
+
+char *csd_load_file(csd_document *doc, const char *path, size_t *size,
+                    csd_source_kind *kind)
+{
+    size_t size_hint = 0;
+    FILE *f;
+
+#ifdef csd_has_mmap
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        csd_file_fail(doc, path, "%s", strerror(errno));
+        return NULL;
     }
 
-    int64_t at = ftell(f);
-    fseek(f, 0, SEEK_END);
-    int64_t fsize = ftell(f);
-    fseek(f, at, SEEK_SET);
+    /* large regular files are mapped, small files and pipes are read */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        size_hint = st.st_size;
+    }
+    if (size_hint >= csd_mmap_threshold) {
+        void *source = mmap(NULL, size_hint, PROT_READ, csd_map_flags, fd, 0);
+        close(fd);
+        if (source == MAP_FAILED) {
+            csd_file_fail(doc, path, "%s", strerror(errno));
+            return NULL;
+        }
+        madvise(source, size_hint, MADV_SEQUENTIAL);
+        *size = size_hint;
+        *kind = csd_source_mapped;
+        return source;
+    }
 
-    char *source = malloc(fsize + 1);
-    if (fread(source, 1, fsize, f) != fsize) {
-        csd_file_throw(&doc, filename, "%s", strerror(errno));
+    f = fdopen(fd, "rb");
+    if (!f) {
+        close(fd);
+        csd_file_fail(doc, path, "%s", strerror(errno));
+        return NULL;
+    }
+#else
+    f = fopen(path, "rb");
+    if (!f) {
+        csd_file_fail(doc, path, "%s", strerror(errno));
+        return NULL;
     }
+#endif
 
-    doc.head = csd_parse_node(&doc);
-    return doc;
+    char *source = csd_read_stream(doc, f, size_hint, size, path);
+    fclose(f);
+    if (!source)
+        return NULL;
+    *kind = csd_source_owned;
+    return source;
+}
+
+void csd_release_source(csd_document *doc)
+{
+    switch (doc->_source_kind) {
+    case csd_source_owned:
+        csd_mem_free(doc->allocator, doc->source);
+        break;
+    case csd_source_borrowed:
+        break;
+    case csd_source_mapped:
+#ifdef csd_has_mmap
+        munmap(doc->source, doc->size);
+#endif
+        break;
+    }
 }
 
 csd_document csd_parse(char *source)
+{
+    return csd_parse_x(source, csd_parse_standard);
+}
+
+csd_document csd_parse_x(char *source, csd_parse_options options)
+{
+    return csd_parse_buffer(source, strlen(source), options, csd_source_owned);
+}
+
+csd_document csd_parse_n(const char *source, size_t size, csd_parse_options options)
+{
+    /* the source is only read, strings are decoded on access */
+    return csd_parse_buffer((char *)source, size, options, csd_source_borrowed);
+}
+
+static csd_document csd_parse_buffer(char *source, size_t size, csd_parse_options options,
+                                     csd_source_kind kind)
 {
     csd_document doc = {0};
+    csd_scanner scanner = {0};
     doc.source = source;
+    doc.size = size;
+    doc.allocator = options.allocator;
     doc._stream = source;
-    doc.error = setjmp(doc._throw_env);
+    doc._scanner = &scanner;
+    doc._source_kind = kind;
+    doc._max_depth = options.max_depth;
+    doc._packed_arrays = options.packed_arrays;
+    /* the index and arena scratch are stb_ds arrays, they follow the document */
+    const csd_allocator *previous = csd_ds_use(doc.allocator);
+
+    /* a job of the shared pool, an allocator say, parses its nested documents alone */
+    csd_pool *pool = options.pool;
+    bool parallel = (options.threads > 1 || pool) && size >= csd_parallel_min_size;
+    if (parallel && !pool) {
+        pool = csd_pool_shared();
+        parallel = !csd_pool_nested(pool);
+    }
 
-    if (doc.error != csd_ok) {
-        csd_free(&doc);
-        return doc;
+    if (csd_pool_nested(options.pool)) {
+        csd_fail(&doc, csd_pool_error, "parse submitted from a job of its own pool");
+    } else if (parallel) {
+        int chunks = options.pool ? csd_pool_threads(pool) : options.threads;
+        doc.head = csd_parse_parallel(&doc, chunks, pool);
+    } else if (!csd_index_window(&scanner.index, doc.source, doc.size)) {
+        /* the parse only moves forward, a window of the index is enough */
+        csd_memory_fail(&doc);
+    } else {
+        /* tape offsets are 32-bit, larger sources are scanned lazily */
+        if (options.tape && doc.size <= UINT32_MAX)
+            csd_tape_build(&doc);
+        if (!csd_read(&doc, csd_token_eof).ok)
+            doc.head = csd_parse_node(&doc, NULL);
     }
-    doc.head = csd_parse_node(&doc);
+
+    /* a failed document only keeps its reason */
+    if (doc.error != csd_ok)
+        csd_doc_release(&doc);
+    csd_index_free(&scanner.index);
+    csd_tape_free(&scanner.tape);
+    doc._scanner = NULL;
+    csd_ds_use(previous);
     return doc;
 }
 
 csd_token csd_scan_token(csd_document *doc);
+void csd_scan_skip(csd_document *doc);
 
 csd_token csd_queue_token(csd_document *doc, csd_token token)
 {
-    doc->_has_queued_token = true;
-    doc->_queued_token = token;
+    csd_scanner *scanner = doc->_scanner;
+    if (scanner->tape.count) {
+        scanner->tape_at--;
+        return token;
+    }
+    scanner->has_queued_token = true;
+    scanner->queued_token = token;
     return token;
 }
 
 csd_token csd_scan(csd_document *doc, csd_token_mask mask)
 {
+    csd_scanner *scanner = doc->_scanner;
     csd_token token;
 
-    if (doc->_has_queued_token) {
-        doc->_has_queued_token = false;
-        token = doc->_queued_token;
+    if (scanner->tape.count) {
+        /* eof ends the tape and is never consumed without failing the parse */
+        token = csd_tape_token(doc, scanner->tape_at++);
+    } else if (scanner->has_queued_token) {
+        scanner->has_queued_token = false;
+        token = scanner->queued_token;
     } else {
         do {
             token = csd_scan_token(doc);
@@ -92,26 +306,36 @@ csd_token csd_scan(csd_document *doc, csd_token_mask mask)
     return token;
 }
 
-csd_token csd_expect(csd_document *doc, csd_token_mask mask)
+csd_token csd_expect_fail(csd_document *doc, csd_token token, csd_token_mask mask)
 {
-    csd_token token = csd_scan(doc, mask);
-    if (!token.ok) {
-        const char **types = NULL;
-        for (int i = 0; csd_bit(i) != csd_token_type_end; i++) {
-            if (csd_bit(i) & mask)
-                arrpush(types, csd_token_typename(csd_bit(i)));
-        }
-
-        char expected[512] = {0};
-        for (int i = 0; i < arrlen(types); i++) {
-            sprintf(expected, "%s'%s'", expected, types[i]);
-            if (i < arrlen(types) - 1)
-                strcat(expected, ", ");
-        }
+    token.ok = false;
+    if (doc->error != csd_ok)
+        return token;
+
+    /* a failed parse allocates nothing but its reason */
+    const char *types[64];
+    int count = 0;
+    for (int i = 0; csd_bit(i) != csd_token_type_end; i++) {
+        if (csd_bit(i) & mask)
+            types[count++] = csd_token_typename(csd_bit(i));
+    }
 
-        arrfree(types);
-        csd_parse_throw(doc, token, "expected: %s", expected);
+    char expected[512] = {0};
+    for (int i = 0; i < count; i++) {
+        sprintf(expected, "%s'%s'", expected, types[i]);
+        if (i < count - 1)
+            strcat(expected, ", ");
     }
+
+    csd_parse_fail(doc, token, "expected: %s", expected);
+    return token;
+}
+
+csd_token csd_expect(csd_document *doc, csd_token_mask mask)
+{
+    csd_token token = csd_scan(doc, mask);
+    if (!token.ok)
+        return csd_expect_fail(doc, token, mask);
     return token;
 }
 
@@ -128,95 +352,252 @@ csd_token csd_read(csd_document *doc, csd_token_mask mask)
     return token;
 }
 
-csd_node *csd_parse_node(csd_document *doc)
+/* reads the key of the next node and returns the first token of its value */
+static csd_token csd_parse_key(csd_document *doc, csd_node **node, uint32_t *hash)
 {
-    csd_node *node;
-    csd_token token1;
-    csd_token token2;
-    const char *key;
-
-    token1 = csd_expect(doc, csd_token_id | csd_token_scope_begin | csd_token_eof);
-
-    switch (token1.type) {
-    case csd_token_scope_begin:
-        key = "";
-        token2 = token1;
-        break;
-    case csd_token_id:
-        key = token1.expr;
-        token2 = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
-        break;
-    case csd_token_eof:
-        return NULL;
-    default:
-        assert(!"unreachable");
+    csd_token key = csd_expect(doc, csd_token_id | csd_token_scope_begin);
+    if (!key.ok)
+        return key;
+    if (key.type == csd_token_scope_begin) {
+        *node = csd_new_nil(doc, "");
+        *hash = csd_hash_basis;
+        return *node ? key : (csd_token){0};
     }
 
-    switch (token2.type) {
-    case csd_token_scope_begin:
-        node = csd_new_sequence(doc, key, NULL);
-        node->value.as_sequence = csd_parse_sequence(doc);
-        break;
-    case csd_token_assign:
-        node = csd_new_nil(doc, key);
-        node->value = csd_parse_value(doc, csd_value_mask);
-        break;
-    default:
-        assert(!"unreachable");
-    }
-
-    return node;
+    const char *name = csd_doc_strndup(doc, key.expr, key.size);
+    *node = name ? csd_new_nil(doc, name) : NULL;
+    *hash = key.hash;
+    if (!*node)
+        return (csd_token){0};
+    csd_token vtoken = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
+    if (vtoken.ok && vtoken.type == csd_token_assign)
+        vtoken = csd_expect(doc, csd_value_mask);
+    return vtoken;
 }
 
-csd_sequence csd_parse_sequence(csd_document *doc)
+typedef struct csd_parse_frame
+{
+    csd_node *node;
+    uint32_t hash;
+    bool sequence;
+    size_t start;
+} csd_parse_frame;
+
+/* containers are walked with an explicit stack, only max_depth bounds the nesting */
+static csd_value csd_parse_tree(csd_document *doc, csd_token vtoken)
 {
-    csd_sequence sequence = NULL;
+    const csd_token_mask containers = csd_token_scope_begin | csd_token_array_begin;
+    size_t max_depth = doc->_max_depth ? doc->_max_depth : csd_default_max_depth;
+    csd_parse_frame frames[csd_parse_stack_frames];
+    csd_parse_frame *stack = frames;
+    size_t capacity = csd_array_sizeof(frames);
+    size_t depth = 0;
+    csd_node *node = NULL;
+    uint32_t hash = 0;
+    csd_value result = csd_vnil;
+    bool open = vtoken.type & containers;
+    bool closed = false;
+
+    if (!open)
+        return csd_token_value(doc, vtoken);
+
+    /* elements wait in the arena scratch until their container is complete */
+    csd_arena *arena = csd_doc_arena(doc);
+    if (!arena)
+        return result;
+    size_t items_base = arrlen(arena->items);
+    size_t buckets_base = arrlen(arena->buckets);
 
     while (1) {
-        if (csd_read(doc, csd_token_scope_end).ok)
+        if (open) {
+            if (doc->_depth + depth >= max_depth) {
+                csd_parse_fail(doc, vtoken, "nesting exceeds the maximum depth of %zu",
+                               max_depth);
+                break;
+            }
+            /* deep documents move the stack to the heap */
+            if (depth == capacity) {
+                csd_parse_frame *grown =
+                    csd_mem_alloc(doc->allocator, 2 * capacity * sizeof(*stack));
+                if (!grown) {
+                    csd_memory_fail(doc);
+                    break;
+                }
+                memcpy(grown, stack, depth * sizeof(*stack));
+                if (stack != frames)
+                    csd_mem_free(doc->allocator, stack);
+                stack = grown;
+                capacity *= 2;
+            }
+            bool sequence = vtoken.type == csd_token_scope_begin;
+            size_t start = sequence ? arrlen(arena->buckets) : arrlen(arena->items);
+            stack[depth++] = (csd_parse_frame){node, hash, sequence, start};
+            open = false;
+        }
+
+        csd_parse_frame *top = &stack[depth - 1];
+        bool sequence = top->sequence;
+        csd_token_mask end = sequence ? csd_token_scope_end : csd_token_array_end;
+        csd_value value;
+
+        if (closed || csd_read(doc, end).ok) {
+            /* a complete container is copied to the arena at its final size */
+            csd_parse_frame frame = stack[--depth];
+            if (frame.sequence) {
+                csd_bucket *buckets = &arena->buckets[frame.start];
+                size_t count = arrlen(arena->buckets) - frame.start;
+                value = csd_vsequence(csd_arena_sequence(arena, buckets, count));
+                arrsetlen(arena->buckets, frame.start);
+            } else {
+                csd_value *items = &arena->items[frame.start];
+                size_t count = arrlen(arena->items) - frame.start;
+                value = csd_varray(doc->_packed_arrays
+                                       ? csd_arena_pack(arena, items, count)
+                                       : csd_arena_array(arena, items, count));
+                arrsetlen(arena->items, frame.start);
+            }
+            if (frame.sequence ? !value.as_sequence : !value.as_array) {
+                csd_memory_fail(doc);
+                break;
+            }
+            if (!depth) {
+                result = value;
+                break;
+            }
+            top = &stack[depth - 1];
+            sequence = top->sequence;
+            end = sequence ? csd_token_scope_end : csd_token_array_end;
+            node = frame.node;
+            hash = frame.hash;
+        } else {
+            node = NULL;
+            vtoken = sequence ? csd_parse_key(doc, &node, &hash)
+                              : csd_expect(doc, csd_item_mask);
+            if (!vtoken.ok)
+                break;
+            open = vtoken.type & containers;
+            if (open)
+                continue;
+            value = csd_token_value(doc, vtoken);
+        }
+
+        bool reserved = sequence
+                            ? csd_ds_reserve(arena->buckets, arrlen(arena->buckets) + 1)
+                            : csd_ds_reserve(arena->items, arrlen(arena->items) + 1);
+        if (!reserved) {
+            csd_memory_fail(doc);
             break;
-        csd_sequence_push(&sequence, csd_parse_node(doc));
-        if (csd_expect(doc, csd_token_scope_end | csd_token_comma).type &
-            csd_token_scope_end)
+        }
+        if (sequence) {
+            node->value = value;
+            arrpush(arena->buckets, ((csd_bucket){node->key, hash, node}));
+        } else {
+            arrpush(arena->items, value);
+        }
+
+        /* a nested sequence closes itself, the comma after it is optional */
+        csd_token_mask separator = end | csd_token_comma;
+        if (sequence && value.type == csd_type_sequence)
+            separator |= csd_token_id | csd_token_scope_begin;
+
+        csd_token token = csd_expect(doc, separator);
+        if (!token.ok)
             break;
+        closed = token.type & end;
+        if (token.type & (csd_token_id | csd_token_scope_begin))
+            csd_queue_token(doc, token);
     }
-    return sequence;
+
+    /* a failed parse drops its open containers, their elements are in the arena */
+    arrsetlen(arena->items, items_base);
+    arrsetlen(arena->buckets, buckets_base);
+    if (stack != frames)
+        csd_mem_free(doc->allocator, stack);
+    return result;
 }
 
-csd_array csd_parse_array(csd_document *doc)
+csd_node *csd_parse_node(csd_document *doc, uint32_t *hash)
+{
+    csd_node *node;
+    uint32_t key_hash;
+    csd_token vtoken = csd_parse_key(doc, &node, &key_hash);
+    if (!vtoken.ok)
+        return NULL;
+
+    node->value = csd_parse_tree(doc, vtoken);
+    if (hash)
+        *hash = key_hash;
+    return node;
+}
+
+csd_value csd_parse_value(csd_document *doc, csd_token_mask mask)
 {
-    csd_array array = NULL;
+    csd_token vtoken = csd_expect(doc, mask);
+    if (!vtoken.ok)
+        return csd_vnil;
+    return csd_parse_tree(doc, vtoken);
+}
 
+void csd_skip_value(csd_document *doc, csd_token vtoken)
+{
+    const csd_token_mask stops = csd_token_eof | csd_token_none;
+    const csd_token_mask any = (csd_token_type_end - 1) & ~stops;
+    const csd_token_mask containers = csd_token_scope_begin | csd_token_array_begin;
+    size_t depth = 0;
+
+    /* unread values are skipped by bracket matching, nothing is built */
+    if (!doc->_scanner->tape.count && (vtoken.type & containers)) {
+        csd_scan_skip(doc);
+        return;
+    }
     while (1) {
-        if (csd_read(doc, csd_token_array_end).ok)
+        if (vtoken.type & (csd_token_scope_begin | csd_token_array_begin))
+            depth++;
+        else if (vtoken.type & (csd_token_scope_end | csd_token_array_end))
+            depth--;
+        if (depth == 0)
             break;
-        csd_array_push(&array, csd_parse_value(doc, csd_item_mask));
-        if (csd_expect(doc, csd_token_array_end | csd_token_comma).type &
-            csd_token_array_end)
+        vtoken = csd_expect(doc, any);
+        if (!vtoken.ok)
             break;
     }
-    return array;
 }
 
-csd_value csd_parse_value(csd_document *doc, csd_token_mask mask)
+csd_value csd_token_value(csd_document *doc, csd_token vtoken)
 {
-    csd_token vtoken = csd_expect(doc, mask);
-
     switch (vtoken.type) {
-    case csd_token_string:
-        return csd_vstring(vtoken.expr);
+    case csd_token_string: {
+        csd_value v = {.type = csd_type_string};
+#ifndef csd_wide_values
+        if (vtoken.size > csd_value_string_max) {
+            csd_parse_fail(doc, vtoken, "string of %zu bytes is too long for a value",
+                           vtoken.size);
+            return csd_vnil;
+        }
+#endif
+        csd_set_string(&v, (csd_string){vtoken.expr, vtoken.size, vtoken.escaped});
+        return v;
+    }
 
     case csd_token_float: {
-        double v = strtod(vtoken.expr, NULL);
-        if (errno != 0)
-            csd_parse_throw(doc, vtoken, "cannot parse float: %s", strerror(errno));
+        double v;
+        if (!csd_float_from_chars(vtoken.expr, vtoken.size, &v)) {
+            csd_parse_fail(doc, vtoken, "float out of range: '%.*s'", (int)vtoken.size,
+                           vtoken.expr);
+            return csd_vnil;
+        }
         return csd_vfloat(v);
     }
 
-    case csd_token_int: {
-        int64_t v = strtol(vtoken.expr, NULL, 0);
-        if (errno != 0)
-            csd_parse_throw(doc, vtoken, "cannot parse int: %s", strerror(errno));
+    case csd_token_int:
+    case csd_token_int_hex:
+    case csd_token_int_binary: {
+        int64_t v;
+        if (!csd_int_from_chars(vtoken.expr, vtoken.size, &v)) {
+            csd_parse_fail(doc, vtoken, "int out of range: '%.*s'", (int)vtoken.size,
+                           vtoken.expr);
+            return csd_vnil;
+        }
         return csd_vint(v);
     }
 
@@ -225,11 +606,6 @@ csd_value csd_parse_value(csd_document *doc, csd_token_mask mask)
     case csd_token_false:
         return csd_vboolean(false);
 
-    case csd_token_scope_begin:
-        return csd_vsequence(csd_parse_sequence(doc));
-    case csd_token_array_begin:
-        return csd_varray(csd_parse_array(doc));
-
     default:
         assert(!"unreachable");
     }
@@ -285,6 +661,10 @@ const char *csd_token_typename(csd_token_type type)
         return "float";
     case csd_token_int:
         return "int";
+    case csd_token_int_hex:
+        return "hex int";
+    case csd_token_int_binary:
+        return "binary int";
     case csd_token_true:
         return "true";
     case csd_token_false:
@@ -0,0 +1,280 @@
+#include "csd.h"
+#include "csd_ds.h"
+#include <assert.h>
+#include <stdlib.h>
+
+extern csd_token_mask csd_value_mask;
+extern csd_token_mask csd_item_mask;
+
+csd_token csd_scan_token(csd_document *doc);
+bool csd_scan_complete(csd_document *doc);
+csd_value csd_token_value(csd_document *doc, csd_token vtoken);
+const char *csd_doc_strndup(csd_document *doc, const char *s, size_t size);
+csd_string csd_doc_string(csd_document *doc, csd_string s);
+void csd_doc_release(csd_document *doc);
+csd_arena *csd_doc_arena(csd_document *doc);
+const csd_allocator *csd_ds_use(const csd_allocator *allocator);
+csd_array csd_arena_array(csd_arena *arena, const csd_value *items, size_t count);
+csd_sequence csd_arena_sequence(csd_arena *arena, const csd_bucket *buckets,
+                                size_t count);
+
+void csd_parser_init(csd_parser *p)
+{
+    *p = (csd_parser){0};
+    p->doc._source_kind = csd_source_borrowed;
+}
+
+static csd_token_mask csd_parser_mask(csd_parser *p)
+{
+    switch (p->state) {
+    case csd_parser_document:
+        return csd_token_eof | csd_token_id | csd_token_scope_begin;
+    case csd_parser_sequence_first:
+        return csd_token_scope_end | csd_token_id | csd_token_scope_begin;
+    case csd_parser_sequence_next:
+        return csd_token_id | csd_token_scope_begin;
+    case csd_parser_sequence_separator:
+        /* a nested sequence closes itself, the comma after it is optional */
+        if (p->after_sequence)
+            return csd_token_comma | csd_token_scope_end | csd_token_id |
+                   csd_token_scope_begin;
+        return csd_token_comma | csd_token_scope_end;
+    case csd_parser_key:
+        return csd_token_assign | csd_token_scope_begin;
+    case csd_parser_value:
+        return csd_value_mask;
+    case csd_parser_array_first:
+        return csd_token_array_end | csd_item_mask;
+    case csd_parser_array_next:
+        return csd_item_mask;
+    case csd_parser_array_separator:
+        return csd_token_comma | csd_token_array_end;
+    case csd_parser_done:
+        return 0;
+    }
+    assert(!"unreachable");
+}
+
+/* containers are grown in the document arena as chunks arrive, max_depth bounds them */
+static void csd_parser_push(csd_parser *p, csd_token token, csd_node *node, bool sequence,
+                            uint32_t hash, csd_parser_state state)
+{
+    size_t max_depth = p->doc._max_depth ? p->doc._max_depth : csd_default_max_depth;
+    /* the node of a sequence is null when out of memory, the document failed then */
+    if (p->doc.error != csd_ok)
+        return;
+    if ((size_t)arrlen(p->stack) >= max_depth) {
+        csd_parse_fail(&p->doc, token, "nesting exceeds the maximum depth of %zu",
+                       max_depth);
+        return;
+    }
+
+    csd_arena *arena = csd_doc_arena(&p->doc);
+    if (!arena)
+        return;
+    csd_value value = sequence ? csd_vsequence(csd_arena_sequence(arena, NULL, 0))
+                               : csd_varray(csd_arena_array(arena, NULL, 0));
+    if ((sequence ? !value.as_sequence : !value.as_array) ||
+        !csd_ds_reserve(p->stack, arrlen(p->stack) + 1)) {
+        csd_memory_fail(&p->doc);
+        return;
+    }
+    arrpush(p->stack, ((csd_parser_frame){node, value, hash}));
+    p->state = state;
+}
+
+static void csd_parser_attach(csd_parser *p, csd_node *node, uint32_t hash)
+{
+    if (arrlen(p->stack) == 0) {
+        p->doc.head = node;
+        p->state = csd_parser_done;
+        return;
+    }
+
+    if (!csd_sequence_push_hashed(&arrlast(p->stack).value.as_sequence, node, hash))
+        csd_memory_fail(&p->doc);
+    p->after_sequence = node->value.type == csd_type_sequence;
+    p->state = csd_parser_sequence_separator;
+}
+
+static void csd_parser_item(csd_parser *p, csd_value value)
+{
+    if (!csd_array_push(&arrlast(p->stack).value.as_array, value))
+        csd_memory_fail(&p->doc);
+    p->state = csd_parser_array_separator;
+}
+
+static void csd_parser_close(csd_parser *p)
+{
+    csd_parser_frame frame = arrpop(p->stack);
+    if (frame.node) {
+        frame.node->value = frame.value;
+        csd_parser_attach(p, frame.node, frame.hash);
+    } else {
+        csd_parser_item(p, frame.value);
+    }
+}
+
+static csd_value csd_parser_scalar(csd_parser *p, csd_token token)
+{
+    csd_value v = csd_token_value(&p->doc, token);
+    /* chunks are released once consumed, so strings are copied out of them */
+    if (v.type == csd_type_string && !v._inline)
+        csd_set_string(&v, csd_doc_string(&p->doc, csd_raw_string(&v)));
+    return v;
+}
+
+static void csd_parser_step(csd_parser *p, csd_token token)
+{
+    csd_document *doc = &p->doc;
+    csd_token_mask mask = csd_parser_mask(p);
+    if (!(token.type & mask)) {
+        csd_expect_fail(doc, token, mask);
+        return;
+    }
+
+    switch (p->state) {
+    case csd_parser_document:
+    case csd_parser_sequence_first:
+    case csd_parser_sequence_next:
+    case csd_parser_sequence_separator:
+        if (token.type == csd_token_eof) {
+            p->state = csd_parser_done;
+        } else if (token.type == csd_token_scope_end) {
+            csd_parser_close(p);
+        } else if (token.type == csd_token_comma) {
+            p->state = csd_parser_sequence_next;
+        } else if (token.type == csd_token_id) {
+            p->key = csd_doc_strndup(doc, token.expr, token.size);
+            p->hash = token.hash;
+            p->state = csd_parser_key;
+        } else {
+            csd_node *node = csd_new_nil(doc, "");
+            csd_parser_push(p, token, node, true, csd_hash_basis,
+                            csd_parser_sequence_first);
+        }
+        break;
+
+    case csd_parser_key:
+        if (token.type == csd_token_assign) {
+            p->state = csd_parser_value;
+        } else {
+            csd_node *node = csd_new_nil(doc, p->key);
+            csd_parser_push(p, token, node, true, p->hash, csd_parser_sequence_first);
+        }
+        break;
+
+    case csd_parser_value: {
+        csd_node *node = csd_new_nil(doc, p->key);
+        if (!node)
+            break;
+        if (token.type == csd_token_array_begin) {
+            csd_parser_push(p, token, node, false, p->hash, csd_parser_array_first);
+        } else {
+            node->value = csd_parser_scalar(p, token);
+            csd_parser_attach(p, node, p->hash);
+        }
+    } break;
+
+    case csd_parser_array_first:
+    case csd_parser_array_next:
+    case csd_parser_array_separator:
+        if (token.type == csd_token_array_end) {
+            csd_parser_close(p);
+        } else if (token.type == csd_token_comma) {
+            p->state = csd_parser_array_next;
+        } else if (token.type == csd_token_array_begin) {
+            csd_parser_push(p, token, NULL, false, 0, csd_parser_array_first);
+        } else if (token.type == csd_token_scope_begin) {
+            csd_parser_push(p, token, NULL, true, 0, csd_parser_sequence_first);
+        } else {
+            csd_parser_item(p, csd_parser_scalar(p, token));
+        }
+        break;
+
+    case csd_parser_done:
+        break;
+    }
+}
+
+static void csd_parser_scan(csd_parser *p, bool last)
+{
+    csd_document *doc = &p->doc;
+    csd_index *index = &p->_scanner.index;
+    doc->source = p->buffer;
+    doc->size = arrlen(p->buffer);
+    doc->_stream = &p->buffer[p->_consumed];
+    doc->_scanner = &p->_scanner;
+    /* only the blocks the new chunks reached are classified */
+    if (!csd_index_extend(index, doc->source, doc->size, p->_indexed)) {
+        csd_memory_fail(doc);
+        return;
+    }
+
+    /* a token reaching the end of the buffer may continue in the next chunk */
+    while (p->state != csd_parser_done && (last || csd_scan_complete(doc))) {
+        csd_token token = csd_scan_token(doc);
+        if (token.type & csd_token_comment)
+            continue;
+        csd_parser_step(p, token);
+        if (doc->error != csd_ok)
+            return;
+    }
+
+    size_t consumed = doc->_stream - doc->source;
+    if (p->state == csd_parser_done)
+        consumed = doc->size;
+
+    /* whole blocks are dropped, the index of the rest stays valid */
+    size_t blocks = consumed / csd_index_block_size;
+    size_t dropped = blocks * csd_index_block_size;
+    csd_source_position(doc, dropped, &doc->_origin_line, &doc->_origin_column);
+    arrdeln(p->buffer, 0, dropped);
+    arrdeln(index->blocks, 0, blocks);
+    p->_consumed = consumed - dropped;
+    p->_indexed = doc->size / csd_index_block_size - blocks;
+    p->retry_size = 2 * (arrlen(p->buffer) - p->_consumed) + p->_consumed;
+}
+
+csd_error csd_parser_feed(csd_parser *p, const char *chunk, size_t size)
+{
+    csd_document *doc = &p->doc;
+    if (doc->error != csd_ok || p->state == csd_parser_done)
+        return doc->error;
+
+    const csd_allocator *previous = csd_ds_use(doc->allocator);
+    if (!csd_ds_reserve(p->buffer, arrlen(p->buffer) + size)) {
+        csd_memory_fail(doc);
+        csd_ds_use(previous);
+        return doc->error;
+    }
+    memcpy(arraddnptr(p->buffer, size), chunk, size);
+    /* an unfinished token is retried once the buffer doubled, keeping rescans linear */
+    if ((size_t)arrlen(p->buffer) >= p->retry_size)
+        csd_parser_scan(p, false);
+    csd_ds_use(previous);
+    return doc->error;
+}
+
+csd_document csd_parser_finish(csd_parser *p)
+{
+    csd_document *doc = &p->doc;
+    const csd_allocator *previous = csd_ds_use(doc->allocator);
+
+    if (doc->error == csd_ok && p->state != csd_parser_done)
+        csd_parser_scan(p, true);
+    if (doc->error != csd_ok)
+        csd_doc_release(doc);
+
+    csd_index_free(&p->_scanner.index);
+    arrfree(p->buffer);
+    arrfree(p->stack);
+    csd_ds_use(previous);
+
+    csd_document result = *doc;
+    result.source = NULL;
+    result.size = 0;
+    result._stream = NULL;
+    result._scanner = NULL;
+    return result;
+}
@@ -1,91 +1,203 @@
 #include "csd.h"
+#include "csd_ds.h"
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
 
-typedef struct csd_keyword
-{
-    const char *word;
-    csd_token_type type;
-} csd_keyword;
+#define csd_keyword(word, type) {word, type, sizeof(word) - 1}
+
+static const bool csd_id_chars[256] = {
+    ['a' ... 'z'] = true,
+    ['A' ... 'Z'] = true,
+    ['0' ... '9'] = true,
+    ['_'] = true,
+};
 
-const csd_keyword csd_keywords[] = {
-    {"'", csd_token_string},    {"\"", csd_token_string},
-    {",", csd_token_comma},     {"{", csd_token_scope_begin},
-    {"}", csd_token_scope_end}, {"[", csd_token_array_begin},
-    {"]", csd_token_array_end}, {":", csd_token_assign},
-    {"true", csd_token_true},   {"false", csd_token_false},
+/* the ranges leave out the first letters of the keywords, no entry is set twice */
+const csd_keyword csd_dispatch[256] = {
+    ['a' ... 'e'] = {NULL, csd_token_id},
+    ['f'] = csd_keyword("false", csd_token_false),
+    ['g' ... 's'] = {NULL, csd_token_id},
+    ['t'] = csd_keyword("true", csd_token_true),
+    ['u' ... 'z'] = {NULL, csd_token_id},
+    ['A' ... 'Z'] = {NULL, csd_token_id},
+    ['_'] = {NULL, csd_token_id},
+    ['0' ... '9'] = {NULL, csd_token_int},
+    ['-'] = {NULL, csd_token_int},
+    ['+'] = {NULL, csd_token_int},
+    ['\''] = csd_keyword("'", csd_token_string),
+    ['"'] = csd_keyword("\"", csd_token_string),
+    ['#'] = csd_keyword("#", csd_token_comment),
+    [','] = csd_keyword(",", csd_token_comma),
+    ['{'] = csd_keyword("{", csd_token_scope_begin),
+    ['}'] = csd_keyword("}", csd_token_scope_end),
+    ['['] = csd_keyword("[", csd_token_array_begin),
+    [']'] = csd_keyword("]", csd_token_array_end),
+    [':'] = csd_keyword(":", csd_token_assign),
 };
-const size_t csd_keyword_count = csd_array_sizeof(csd_keywords);
 
 void csd_eat_char(csd_document *doc)
 {
-    if (*doc->_stream != '\n')
-        doc->_column++;
-    else
-        doc->_line++, doc->_column = 0;
     doc->_stream++;
 }
 
+void csd_eat_to(csd_document *doc, char *end)
+{
+    doc->_stream = end;
+}
+
 csd_token csd_eat(csd_document *doc, csd_token_type type, size_t size)
 {
     csd_token token = {0};
-    token.line = doc->_line;
-    token.column = doc->_column;
+    token.offset = doc->_stream - doc->source;
     token.type = type;
     token.expr = doc->_stream;
     token.size = size;
 
-    for (size_t i = 0; i < size; i++)
-        csd_eat_char(doc);
+    doc->_stream += size;
     return token;
 }
 
+size_t csd_stream_at(csd_document *doc)
+{
+    return doc->_stream - doc->source;
+}
+
 csd_token csd_eat_dumb(csd_document *doc)
 {
-    const char *end = doc->_stream;
-    while (*end != '\0' && !isspace(*end))
-        end++;
-    return csd_eat(doc, csd_token_none, end - doc->_stream);
+    size_t end =
+        csd_index_next(&doc->_scanner->index, csd_stream_at(doc), csd_index_whitespace);
+    return csd_eat(doc, csd_token_none, end - csd_stream_at(doc));
 }
 
-csd_token csd_eat_into(csd_document *doc, csd_token_type type, const char *into)
+csd_token csd_eat_into(csd_document *doc, csd_token_type type, char into)
 {
-    const char *end = strstr(doc->_stream, into);
+    size_t remaining = doc->size - csd_stream_at(doc);
+    const char *end = memchr(doc->_stream, into, remaining);
     if (!end) {
-        end = &doc->source[strlen(doc->source)];
+        end = &doc->source[doc->size];
     }
     return csd_eat(doc, type, end - doc->_stream);
 }
 
+static inline char *csd_move_run(char *out, const char *run, size_t size)
+{
+    if (out == run)
+        return out + size;
+    if (size < 16) {
+        for (size_t i = 0; i < size; i++)
+            out[i] = run[i];
+    } else {
+        memmove(out, run, size);
+    }
+    return out + size;
+}
+
+csd_token csd_eat_string(csd_document *doc)
+{
+    csd_index *index = &doc->_scanner->index;
+    const csd_index_class classes = csd_index_quote | csd_index_backslash;
+    char quote = *doc->_stream;
+    char *begin = doc->_stream + 1;
+    char *run = begin;
+    char *out = begin;
+    char *it;
+
+    bool decode = doc->_source_kind == csd_source_owned;
+    bool escaped = false;
+
+    size_t from = begin - doc->source;
+    size_t block = from / csd_index_block_size;
+    size_t blocks = index->count;
+    uint64_t bits = 0;
+
+    if (block < blocks)
+        bits = csd_index_mask(index, block, classes) &
+               ~0ull << from % csd_index_block_size;
+
+    for (;;) {
+        while (!bits) {
+            if (++block >= blocks)
+                return csd_scan_fail(doc, csd_eat_dumb(doc), "unterminated string");
+            bits = csd_index_mask(index, block, classes);
+            if (block == from / csd_index_block_size)
+                bits &= ~0ull << from % csd_index_block_size;
+        }
+
+        size_t at = block * csd_index_block_size + csd_ctz64(bits);
+        bits &= bits - 1;
+        it = &doc->source[at];
+
+        if (*it == quote)
+            break;
+        if (*it != '\\')
+            continue;
+
+        uint8_t c = at + 1 < doc->size ? it[1] : '\0';
+        if (!csd_is_char_escape_sequence[c]) {
+            csd_eat_to(doc, it);
+            return csd_scan_fail(doc, csd_eat(doc, csd_token_string, 2),
+                                 "unknown escape sequence: '\\%c'", c);
+        }
+
+        escaped = true;
+        if (decode) {
+            out = csd_move_run(out, run, it - run);
+            *out++ = csd_char_to_escape_sequence[c];
+            run = it + 2;
+        }
+
+        from = at + 2;
+        if (from / csd_index_block_size != block)
+            bits = 0;
+        else
+            bits &= ~0ull << from % csd_index_block_size;
+    }
+
+    csd_token token = {0};
+    token.type = csd_token_string;
+    token.offset = begin - doc->source;
+    token.expr = begin;
+
+    if (decode) {
+        out = csd_move_run(out, run, it - run);
+        *out = '\0';
+        token.size = out - begin;
+    } else {
+        /* only owned sources are written, escapes are decoded on access */
+        token.size = it - begin;
+        token.escaped = escaped;
+    }
+    csd_eat_to(doc, it + 1);
+    return token;
+}
+
+size_t csd_unescape(char *out, const char *s, size_t size)
+{
+    const char *end = s + size;
+    const char *seq;
+    char *begin = out;
+
+    while ((seq = memchr(s, '\\', end - s)) != NULL) {
+        out = csd_move_run(out, s, seq - s);
+        *out++ = csd_char_to_escape_sequence[(uint8_t)seq[1]];
+        s = seq + 2;
+    }
+    out = csd_move_run(out, s, end - s);
+    return out - begin;
+}
+
 csd_token csd_eat_keyword(csd_document *doc, csd_keyword keyword)
 {
     csd_token token;
 
     switch (keyword.type) {
-    case csd_token_string: {
-        csd_eat_char(doc);
-        token = csd_eat_into(doc, csd_token_string, keyword.word);
-
-        if (!token.expr[token.size])
-            csd_scan_throw(doc, token, "unterminated string", keyword.word);
-
-        char *seq = token.expr;
-        while ((seq = strchr(seq, '\\')) != NULL) {
-            size_t index = seq - token.expr;
-            if (index >= token.size)
-                break;
-            if (!csd_is_char_escape_sequence[seq[1]])
-                csd_scan_throw(doc, token, "unknown escape sequence: '\\%c'", seq[1]);
-            seq[0] = csd_char_to_escape_sequence[seq[1]];
-            memmove(seq + 1, seq + 2, token.size - index - 1);
-            token.size--;
-        }
-        token.expr[token.size] = '\0';
-    } break;
+    case csd_token_string:
+        token = csd_eat_string(doc);
+        break;
 
     case csd_token_comment:
-        token = csd_eat_into(doc, csd_token_comment, "\n");
+        token = csd_eat_into(doc, csd_token_comment, '\n');
         break;
 
     case csd_token_assign:
@@ -96,7 +208,7 @@ csd_token csd_eat_keyword(csd_document *doc, csd_keyword keyword)
     case csd_token_array_end:
     case csd_token_true:
     case csd_token_false:
-        token = csd_eat(doc, keyword.type, strlen(keyword.word));
+        token = csd_eat(doc, keyword.type, keyword.size);
         break;
 
     default:
@@ -108,67 +220,204 @@ csd_token csd_eat_keyword(csd_document *doc, csd_keyword keyword)
 
 csd_token csd_eat_id(csd_document *doc)
 {
-    csd_token token;
-    static char buf[64];
-
     const char *it = doc->_stream;
-    if (isalpha(*it))
+    const char *end = doc->source + doc->size;
+    uint32_t hash = csd_hash_basis;
+
+    while (it < end && csd_id_chars[(uint8_t)*it]) {
+        hash = (hash ^ (uint8_t)*it) * csd_hash_prime;
         it++;
-    while (isalnum(*it))
+    }
+
+    csd_token token = csd_eat(doc, csd_token_id, it - doc->_stream);
+    token.hash = hash;
+    return token;
+}
+
+bool csd_match_word(csd_document *doc, csd_keyword keyword)
+{
+    size_t at = csd_stream_at(doc);
+    if (doc->size - at < keyword.size)
+        return false;
+    if (memcmp(doc->_stream, keyword.word, keyword.size) != 0)
+        return false;
+
+    char next = at + keyword.size < doc->size ? doc->_stream[keyword.size] : '\0';
+    return !csd_id_chars[(uint8_t)next];
+}
+
+const char *csd_eat_digits(const char *it, const char *end, unsigned base)
+{
+    while (it < end && csd_digit_values[(uint8_t)*it] < base)
         it++;
-    /* = csd_eat(doc, csd_token_id, it - doc->_stream); */
+    return it;
 }
 
 csd_token csd_eat_number(csd_document *doc)
 {
     const char *it = doc->_stream;
+    const char *end = doc->source + doc->size;
     csd_token_type type = csd_token_int;
+    unsigned base = 10;
 
     if (*it == '-' || *it == '+')
         it++;
-    if (strncmp(it, "0x", 2) == 0)
-        type = csd_token_int_hex, it = &it[2];
-    if (strncmp(it, "0b", 2) == 0)
-        type = csd_token_int_binary, it = &it[2];
+    if (end - it >= 2 && it[0] == '0' && (it[1] == 'x' || it[1] == 'X')) {
+        type = csd_token_int_hex;
+        base = 16;
+        it += 2;
+    } else if (end - it >= 2 && it[0] == '0' && (it[1] == 'b' || it[1] == 'B')) {
+        type = csd_token_int_binary;
+        base = 2;
+        it += 2;
+    }
 
-    while (isdigit(*it))
-        it++;
-    if (*it == '.') {
+    const char *digits = it;
+    it = csd_eat_digits(it, end, base);
+    size_t count = it - digits;
+
+    if (it < end && *it == '.') {
         if (type & (csd_token_int_hex | csd_token_int_binary)) {
-            csd_scan_throw(doc, csd_eat_dumb(doc),
-                           "hex/binary float representation is not supported");
+            return csd_scan_fail(doc, csd_eat_dumb(doc),
+                                 "hex/binary float representation is not supported");
         }
 
         type = csd_token_float;
-        while (isdigit(*it))
+        digits = it + 1;
+        it = csd_eat_digits(digits, end, 10);
+        count += it - digits;
+    }
+    if (count == 0)
+        return csd_scan_fail(doc, csd_eat_dumb(doc), "number has no digits");
+
+    if (type & (csd_token_int | csd_token_float) && it < end &&
+        (*it == 'e' || *it == 'E')) {
+        type = csd_token_float;
+        if (++it < end && (*it == '-' || *it == '+'))
             it++;
+        digits = it;
+        it = csd_eat_digits(it, end, 10);
+        if (it == digits)
+            return csd_scan_fail(doc, csd_eat_dumb(doc), "float exponent has no digits");
     }
     return csd_eat(doc, type, it - doc->_stream);
 }
 
-csd_token csd_scan_token(csd_document *doc)
+/* returns the offset of the quote closing the string opened at offset at */
+static size_t csd_string_end(csd_document *doc, size_t at)
 {
-    if (*doc->_stream == '\0')
-        return csd_eat(doc, csd_token_eof, 0);
-redo:
-    while (isspace(*doc->_stream)) {
-        csd_eat_char(doc);
+    const csd_index_class classes = csd_index_quote | csd_index_backslash;
+    char quote = doc->source[at];
+    size_t it = csd_index_next(&doc->_scanner->index, at + 1, classes);
+
+    while (it < doc->size && doc->source[it] != quote) {
+        size_t next = it + (doc->source[it] == '\\' ? 2 : 1);
+        it = csd_index_next(&doc->_scanner->index, next, classes);
     }
+    return it;
+}
 
-    for (int i = 0; i < csd_keyword_count; i++) {
-        csd_keyword keyword = csd_keywords[i];
+bool csd_scan_complete(csd_document *doc)
+{
+    csd_index *index = &doc->_scanner->index;
+    size_t at = csd_index_skip(index, csd_stream_at(doc), csd_index_whitespace);
+    if (at >= doc->size)
+        return false;
 
-        if (strncmp(keyword.word, doc->_stream, strlen(keyword.word)) == 0) {
-            return csd_eat_keyword(doc, keyword);
+    char c = doc->source[at];
+    switch (csd_dispatch[(uint8_t)c].type) {
+    case csd_token_string:
+        return csd_string_end(doc, at) < doc->size;
+
+    case csd_token_comment:
+        return memchr(&doc->source[at], '\n', doc->size - at) != NULL;
+
+    case csd_token_id:
+    case csd_token_int:
+    case csd_token_true:
+    case csd_token_false: {
+        /* words and numbers may continue in the next chunk until a delimiter shows up */
+        const csd_index_class delimiters =
+            csd_index_whitespace | csd_index_structural | csd_index_quote;
+        return csd_index_next(index, at, delimiters) < doc->size;
+    }
+
+    default:
+        return true;
+    }
+}
+
+void csd_scan_skip(csd_document *doc)
+{
+    const csd_index_class classes = csd_index_structural | csd_index_quote;
+    size_t at = csd_stream_at(doc);
+    size_t depth = 1;
+
+    /* jumps bracket to bracket over the index, strings and comments are passed whole */
+    while (depth) {
+        at = csd_index_next(&doc->_scanner->index, at, classes);
+        if (at >= doc->size) {
+            csd_eat_to(doc, &doc->source[doc->size]);
+            csd_expect_fail(doc, csd_eat(doc, csd_token_eof, 0),
+                            csd_token_scope_end | csd_token_array_end);
+            return;
+        }
+
+        switch (doc->source[at]) {
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            break;
+        case '\'':
+        case '"': {
+            size_t end = csd_string_end(doc, at);
+            if (end >= doc->size) {
+                csd_eat_to(doc, &doc->source[at]);
+                csd_scan_fail(doc, csd_eat_dumb(doc), "unterminated string");
+                return;
+            }
+            at = end;
+        } break;
+        case '#': {
+            const char *newline = memchr(&doc->source[at], '\n', doc->size - at);
+            at = newline ? (size_t)(newline - doc->source) : doc->size - 1;
+        } break;
         }
+        at++;
     }
+    csd_eat_to(doc, &doc->source[at]);
+}
+
+csd_token csd_scan_token(csd_document *doc)
+{
+    size_t at =
+        csd_index_skip(&doc->_scanner->index, csd_stream_at(doc), csd_index_whitespace);
+    csd_eat_to(doc, &doc->source[at]);
+
+    if (at >= doc->size)
+        return csd_eat(doc, csd_token_eof, 0);
+
+    csd_keyword keyword = csd_dispatch[(uint8_t)*doc->_stream];
+    if (!keyword.type)
+        return csd_scan_fail(doc, csd_eat_dumb(doc), "unknown token encountered");
 
-    if (isalpha(*doc->_stream)) {
+    switch (keyword.type) {
+    case csd_token_id:
         return csd_eat_id(doc);
-    }
-    if (*doc->_stream == '-' || *doc->_stream == '+' || isdigit(*doc->_stream)) {
+    case csd_token_int:
         return csd_eat_number(doc);
-    }
 
-    csd_scan_throw(doc, csd_eat_dumb(doc), "unknown token encountered");
+    case csd_token_true:
+    case csd_token_false:
+        if (csd_match_word(doc, keyword))
+            return csd_eat_keyword(doc, keyword);
+        return csd_eat_id(doc);
+
+    default:
+        return csd_eat_keyword(doc, keyword);
+    }
 }
@@ -0,0 +1,277 @@
+#include "csd.h"
+#include "csd_ds.h"
+#include <assert.h>
+#include <stdlib.h>
+
+extern csd_token_mask csd_value_mask;
+extern csd_token_mask csd_item_mask;
+
+csd_token csd_expect(csd_document *doc, csd_token_mask mask);
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_token csd_queue_token(csd_document *doc, csd_token token);
+csd_value csd_parse_value(csd_document *doc, csd_token_mask mask);
+void csd_skip_value(csd_document *doc, csd_token vtoken);
+void csd_scan_skip(csd_document *doc);
+const char *csd_doc_strndup(csd_document *doc, const char *s, size_t size);
+void csd_doc_release(csd_document *doc);
+csd_arena *csd_doc_arena(csd_document *doc);
+csd_array csd_arena_array(csd_arena *arena, const csd_value *items, size_t count);
+csd_sequence csd_arena_sequence(csd_arena *arena, const csd_bucket *buckets,
+                                size_t count);
+
+typedef struct csd_select_segment
+{
+    const char *key;
+    size_t size;
+    size_t index;
+} csd_select_segment;
+
+typedef struct csd_select
+{
+    csd_document doc;
+    csd_scanner scanner;
+    csd_select_segment **paths;
+} csd_select;
+
+#define csd_select_is_index(segment) ((segment)->key == NULL)
+
+static csd_select_segment *csd_select_fail(csd_select *s, csd_select_segment *segments,
+                                           const char *path, const char *reason)
+{
+    arrfree(segments);
+    csd_fail(&s->doc, csd_scan_error, "path '%s': %s", path, reason);
+    return NULL;
+}
+
+/* splits 'tetris.window.width' or 'colors.gray[0]' into keys and indices */
+static csd_select_segment *csd_select_path(csd_select *s, const char *path)
+{
+    csd_select_segment *segments = NULL;
+    const char *it = path;
+
+    if (!*it)
+        return csd_select_fail(s, segments, path, "expected a key");
+    while (*it) {
+        if (!csd_ds_reserve(segments, arrlen(segments) + 1)) {
+            arrfree(segments);
+            csd_memory_fail(&s->doc);
+            return NULL;
+        }
+        if (*it == '[') {
+            /* plain decimal digits, a sign, a space or an overflow is not an index */
+            const char *digits = ++it;
+            size_t index = 0;
+            for (; *it >= '0' && *it <= '9'; it++) {
+                size_t digit = *it - '0';
+                if (index > (SIZE_MAX - digit) / 10)
+                    break;
+                index = index * 10 + digit;
+            }
+            if (it == digits || *it != ']')
+                return csd_select_fail(s, segments, path, "expected an index");
+            arrpush(segments, ((csd_select_segment){NULL, 0, index}));
+            it++;
+        } else {
+            if (arrlen(segments) && *it++ != '.')
+                return csd_select_fail(s, segments, path, "expected '.' or '['");
+            size_t size = strcspn(it, ".[");
+            if (!size)
+                return csd_select_fail(s, segments, path, "expected a key");
+            arrpush(segments, ((csd_select_segment){it, size, 0}));
+            it += size;
+        }
+    }
+    return segments;
+}
+
+static bool csd_select_value(csd_select *s, int *active, size_t depth, csd_token vtoken,
+                             csd_value *value);
+
+/* reads the key of the next node and returns the first token of its value */
+static csd_token csd_select_node(csd_document *doc, csd_token *key)
+{
+    *key = csd_expect(doc, csd_token_id | csd_token_scope_begin);
+    if (!key->ok)
+        return *key;
+    if (key->type == csd_token_scope_begin) {
+        csd_token vtoken = *key;
+        key->expr = "";
+        key->size = 0;
+        key->hash = csd_hash_basis;
+        return vtoken;
+    }
+
+    csd_token vtoken = csd_expect(doc, csd_token_assign | csd_token_scope_begin);
+    if (vtoken.ok && vtoken.type == csd_token_assign)
+        vtoken = csd_expect(doc, csd_value_mask);
+    return vtoken;
+}
+
+/* array items have no key and only match indices */
+static bool csd_select_matches(csd_select_segment *segment, csd_token key, size_t index)
+{
+    if (csd_select_is_index(segment))
+        return !key.expr && segment->index == index;
+    return key.expr && segment->size == key.size &&
+           !memcmp(segment->key, key.expr, key.size);
+}
+
+/* selects in the elements of a container, once every path matched the rest is skipped */
+static csd_value csd_select_container(csd_select *s, int *active, size_t depth,
+                                      bool sequence)
+{
+    csd_document *doc = &s->doc;
+    csd_token_mask end = sequence ? csd_token_scope_end : csd_token_array_end;
+    csd_arena *arena = csd_doc_arena(doc);
+    if (!arena)
+        return csd_vnil;
+    csd_value result = sequence ? csd_vsequence(csd_arena_sequence(arena, NULL, 0))
+                                : csd_varray(csd_arena_array(arena, NULL, 0));
+    if (sequence ? !result.as_sequence : !result.as_array) {
+        csd_memory_fail(doc);
+        return csd_vnil;
+    }
+    bool selected = false;
+    size_t matched = 0;
+    int *matching = NULL;
+
+    for (size_t i = 0;; i++) {
+        if (csd_read(doc, end).ok)
+            break;
+
+        csd_token key = {0};
+        csd_token vtoken =
+            sequence ? csd_select_node(doc, &key) : csd_expect(doc, csd_item_mask);
+        if (!vtoken.ok)
+            break;
+
+        if (!csd_ds_reserve(matching, arrlen(active))) {
+            csd_memory_fail(doc);
+            break;
+        }
+        arrsetlen(matching, 0);
+        for (size_t p = 0; p < (size_t)arrlen(active); p++) {
+            if (csd_select_matches(&s->paths[active[p]][depth], key, i))
+                arrpush(matching, active[p]);
+        }
+
+        csd_value value = csd_vnil;
+        if (!arrlen(matching))
+            csd_skip_value(doc, vtoken);
+        else if (csd_select_value(s, matching, depth + 1, vtoken, &value))
+            selected = true;
+
+        if (sequence && value.type != csd_type_nil) {
+            const char *name = csd_doc_strndup(doc, key.expr, key.size);
+            csd_node *node = name ? csd_new_nil(doc, name) : NULL;
+            if (!node)
+                break;
+            node->value = value;
+            if (!csd_sequence_push_hashed(&result.as_sequence, node, key.hash))
+                csd_memory_fail(doc);
+        } else if (!sequence && !csd_array_push(&result.as_array, value)) {
+            csd_memory_fail(doc);
+        }
+
+        matched += arrlen(matching);
+        if (matched >= (size_t)arrlen(active)) {
+            csd_scan_skip(doc);
+            break;
+        }
+
+        /* a nested sequence closes itself, the comma after it is optional */
+        csd_token_mask separator = end | csd_token_comma;
+        if (sequence && vtoken.type == csd_token_scope_begin)
+            separator |= csd_token_id | csd_token_scope_begin;
+
+        csd_token token = csd_expect(doc, separator);
+        if (!token.ok || token.type & end)
+            break;
+        if (token.type & (csd_token_id | csd_token_scope_begin))
+            csd_queue_token(doc, token);
+    }
+
+    arrfree(matching);
+    /* unselected containers are left in the arena */
+    if (!selected || doc->error != csd_ok)
+        result = csd_vnil;
+    return result;
+}
+
+/* parses the value if a path ends on it, descends if a path goes through it */
+static bool csd_select_value(csd_select *s, int *active, size_t depth, csd_token vtoken,
+                             csd_value *value)
+{
+    csd_document *doc = &s->doc;
+
+    for (size_t p = 0; p < (size_t)arrlen(active); p++) {
+        if ((size_t)arrlen(s->paths[active[p]]) == depth) {
+            csd_queue_token(doc, vtoken);
+            *value = csd_parse_value(doc, vtoken.type);
+            return true;
+        }
+    }
+
+    if (vtoken.type == csd_token_scope_begin)
+        *value = csd_select_container(s, active, depth, true);
+    else if (vtoken.type == csd_token_array_begin)
+        *value = csd_select_container(s, active, depth, false);
+    return value->type != csd_type_nil;
+}
+
+csd_document csd_parse_select(const char *source, const char **paths, size_t n)
+{
+    csd_select s = {0};
+    csd_document *doc = &s.doc;
+    doc->source = (char *)source;
+    doc->size = strlen(source);
+    doc->_stream = doc->source;
+    doc->_source_kind = csd_source_borrowed;
+    doc->_scanner = &s.scanner;
+    int *active = NULL;
+
+    /* the parse is forward only, a window of the index is enough */
+    if (!csd_index_window(&s.scanner.index, doc->source, doc->size) ||
+        !csd_ds_reserve(s.paths, n) || !csd_ds_reserve(active, n))
+        csd_memory_fail(doc);
+
+    for (size_t i = 0; i < n && doc->error == csd_ok; i++) {
+        csd_select_segment *segments = csd_select_path(&s, paths[i]);
+        if (segments)
+            arrpush(s.paths, segments);
+    }
+
+    if (doc->error == csd_ok && !csd_read(doc, csd_token_eof).ok) {
+        csd_token key;
+        csd_token vtoken = csd_select_node(doc, &key);
+        csd_value value = csd_vnil;
+        size_t depth = 0;
+
+        /* a named root is the first segment of every path, an anonymous one is not */
+        for (int p = 0; p < (int)n && vtoken.ok; p++) {
+            if (!key.size || csd_select_matches(&s.paths[p][0], key, 0))
+                arrpush(active, p);
+        }
+        if (key.size)
+            depth++;
+
+        if (!arrlen(active))
+            csd_skip_value(doc, vtoken);
+        else if (csd_select_value(&s, active, depth, vtoken, &value)) {
+            const char *name = csd_doc_strndup(doc, key.expr, key.size);
+            doc->head = name ? csd_new_nil(doc, name) : NULL;
+            if (doc->head)
+                doc->head->value = value;
+        }
+    }
+    if (doc->error != csd_ok)
+        csd_doc_release(doc);
+
+    for (size_t i = 0; i < (size_t)arrlen(s.paths); i++)
+        arrfree(s.paths[i]);
+    arrfree(s.paths);
+    arrfree(active);
+    csd_index_free(&s.scanner.index);
+    doc->_scanner = NULL;
+    return *doc;
+}
@@ -0,0 +1,110 @@
+#include "csd.h"
+#include "csd_ds.h"
+
+csd_token csd_read(csd_document *doc, csd_token_mask mask);
+csd_node *csd_parse_node(csd_document *doc, uint32_t *hash);
+size_t csd_stream_at(csd_document *doc);
+void csd_doc_reset(csd_document *doc);
+void csd_arena_reset(csd_arena *arena);
+void csd_release_source(csd_document *doc);
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+char *csd_load_file(csd_document *doc, const char *path, size_t *size,
+                    csd_source_kind *kind);
+
+void csd_stream_open(csd_stream *s, const char *source, size_t size,
+                     const csd_allocator *allocator)
+{
+    *s = (csd_stream){0};
+    s->source = (char *)source;
+    s->size = size;
+    s->allocator = allocator;
+    s->_source_kind = csd_source_borrowed;
+
+    /* documents are read front to back, they share a window of the index */
+    const csd_allocator *previous = csd_ds_use(allocator);
+    if (!csd_index_window(&s->_scanner.index, s->source, s->size))
+        s->error = csd_memory_error;
+    csd_ds_use(previous);
+}
+
+csd_error csd_stream_open_file(csd_stream *s, const char *path,
+                               const csd_allocator *allocator)
+{
+    csd_document doc = {.allocator = allocator};
+    size_t size;
+    csd_source_kind kind;
+    char *source = csd_load_file(&doc, path, &size, &kind);
+
+    if (!source) {
+        *s = (csd_stream){.allocator = allocator, .error = doc.error};
+        s->reason = doc.reason;
+        return s->error;
+    }
+    csd_stream_open(s, source, size, allocator);
+    s->_source_kind = kind;
+    return s->error;
+}
+
+void csd_stream_close(csd_stream *s)
+{
+    csd_document doc = {0};
+    doc.source = s->source;
+    doc.size = s->size;
+    doc.allocator = s->allocator;
+    doc._source_kind = s->_source_kind;
+    csd_release_source(&doc);
+    csd_index_free(&s->_scanner.index);
+    csd_mem_free(s->allocator, s->reason);
+    s->reason = NULL;
+}
+
+/* documents borrow the stream source, with reuse the previous arena is recycled */
+bool csd_stream_next(csd_stream *s, csd_document *doc)
+{
+    csd_arena *arena = NULL;
+    if (s->reuse && s->_has_document) {
+        csd_arena_reset(doc->_arena);
+        arena = doc->_arena;
+        csd_mem_free(doc->allocator, doc->reason);
+    }
+    s->_has_document = true;
+
+    *doc = (csd_document){0};
+    doc->source = s->source;
+    doc->size = s->size;
+    doc->allocator = s->allocator;
+    doc->_arena = arena;
+    doc->_stream = &s->source[s->at];
+    doc->_source_kind = csd_source_borrowed;
+
+    if (s->error != csd_ok) {
+        csd_free(doc);
+        return false;
+    }
+
+    s->_scanner.has_queued_token = false;
+    doc->_scanner = &s->_scanner;
+    if (csd_read(doc, csd_token_eof).ok) {
+        doc->_scanner = NULL;
+        csd_free(doc);
+        return false;
+    }
+
+    const csd_allocator *previous = csd_ds_use(s->allocator);
+    doc->head = csd_parse_node(doc, NULL);
+    csd_ds_use(previous);
+    s->at = csd_stream_at(doc);
+    if (doc->error != csd_ok) {
+        /* the stream can not resynchronize past a broken document */
+        s->error = doc->error;
+        size_t size = doc->reason ? strlen(doc->reason) + 1 : 0;
+        s->reason = size ? csd_mem_alloc(s->allocator, size) : NULL;
+        if (s->reason)
+            memcpy(s->reason, doc->reason, size);
+        csd_doc_reset(doc);
+    }
+
+    doc->_scanner = NULL;
+    return true;
+}
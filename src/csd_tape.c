@@ -0,0 +1,83 @@
+#include "csd.h"
+#include <stdlib.h>
+
+csd_token csd_scan_token(csd_document *doc);
+void *csd_mem_realloc(const csd_allocator *a, void *p, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
+
+/* a column is only replaced once it grew, a failed reserve leaves the tape usable */
+static bool csd_tape_column(const csd_allocator *a, void **column, size_t size)
+{
+    void *grown = csd_mem_realloc(a, *column, size);
+    if (grown)
+        *column = grown;
+    return grown != NULL;
+}
+
+static bool csd_tape_reserve(csd_tape *tape, size_t capacity)
+{
+    const csd_allocator *a = tape->allocator;
+    if (capacity <= tape->capacity)
+        return true;
+    if (!csd_tape_column(a, (void **)&tape->types, capacity * sizeof(*tape->types)) ||
+        !csd_tape_column(a, (void **)&tape->offsets, capacity * sizeof(*tape->offsets)) ||
+        !csd_tape_column(a, (void **)&tape->sizes, capacity * sizeof(*tape->sizes)) ||
+        !csd_tape_column(a, (void **)&tape->hashes, capacity * sizeof(*tape->hashes)))
+        return false;
+    tape->capacity = capacity;
+    return true;
+}
+
+void csd_tape_build(csd_document *doc)
+{
+    csd_tape *tape = &doc->_scanner->tape;
+    csd_token token;
+    tape->allocator = doc->allocator;
+
+    /* roughly one token per 4 bytes of source, grown on demand past that */
+    if (!csd_tape_reserve(tape, doc->size / 4 + 16)) {
+        csd_memory_fail(doc);
+        return;
+    }
+
+    do {
+        token = csd_scan_token(doc);
+        if (token.type & csd_token_comment)
+            continue;
+        bool full = tape->count == tape->capacity;
+        if (full && !csd_tape_reserve(tape, tape->capacity * 2)) {
+            csd_memory_fail(doc);
+            return;
+        }
+
+        tape->types[tape->count] = csd_ctz64(token.type);
+        if (token.escaped)
+            tape->types[tape->count] |= csd_tape_escaped;
+        tape->offsets[tape->count] = token.offset;
+        tape->sizes[tape->count] = token.size;
+        tape->hashes[tape->count] = token.hash;
+        tape->count++;
+    } while (token.type != csd_token_eof);
+}
+
+void csd_tape_free(csd_tape *tape)
+{
+    csd_mem_free(tape->allocator, tape->types);
+    csd_mem_free(tape->allocator, tape->offsets);
+    csd_mem_free(tape->allocator, tape->sizes);
+    csd_mem_free(tape->allocator, tape->hashes);
+    *tape = (csd_tape){0};
+}
+
+csd_token csd_tape_token(const csd_document *doc, size_t i)
+{
+    const csd_tape *tape = &doc->_scanner->tape;
+    csd_token token = {0};
+    token.type = csd_bit(tape->types[i] & ~csd_tape_escaped);
+    token.escaped = tape->types[i] & csd_tape_escaped;
+    token.offset = tape->offsets[i];
+    token.expr = &doc->source[token.offset];
+    token.size = tape->sizes[i];
+    token.hash = tape->hashes[i];
+    return token;
+}
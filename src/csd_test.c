@@ -1,7 +1,12 @@
 #include "acutest.h"
 #include "csd.h"
+#include <stdarg.h>
 #include <stdio.h>
 
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
 const char *csd_game_source = ""
                               "tetris {\n"
                               "  window {\n"
@@ -72,6 +77,18 @@ const char *csd_features_source =
     " ứng dụng dàn trang.'\n"
     "}";
 
+const char *csd_mixed_source =
+    ""
+    "# header comment\n"
+    "{\n"
+    "  name: 'multi\\'line\\n',\n"
+    "  n: -12345, f: 6.02214076e23, h: 0x7f, b: 0b101,\n"
+    "  yes: true, no: false, # trailing comment\n"
+    "  items: [1, [2, 3], {x: 'y'}, 'z', []],\n"
+    "  nested { deep { deeper: 1 } }\n"
+    "  tail: 'end'\n"
+    "}";
+
 typedef struct csd_neq_status
 {
     bool has_neq;
@@ -93,6 +110,12 @@ void csd_node_neq_cb(csd_node *a, csd_node *b, void *p)
     status->has_neq = true;
 }
 
+bool csd_test_string(csd_document *doc, csd_node *node, const char *expected)
+{
+    csd_string s = csd_str(doc, node);
+    return s.size == strlen(expected) && memcmp(s.data, expected, s.size) == 0;
+}
+
 void csd_test_parse(const char *source, csd_document *expected)
 {
     csd_document got = csd_parse(strdup(source));
@@ -101,6 +124,21 @@ void csd_test_parse(const char *source, csd_document *expected)
     csd_neq_status status = {0};
     csd_eq_x(expected->head, got.head, &csd_node_neq_cb, &status);
     TEST_CHECK_(!status.has_neq, "%s", status.why);
+    csd_free(&got);
+}
+
+csd_node *csd_test_game(csd_document *doc)
+{
+    return csd_make_sequence(
+        doc, "tetris",
+        csd_make_sequence(doc, "window", csd_new_int(doc, "width", 1920),
+                          csd_new_int(doc, "height", 1080),
+                          csd_new_string(doc, "title", "Tetris game"),
+                          csd_new_boolean(doc, "fullscreen", false)),
+        csd_make_sequence(doc, "controls", csd_new_string(doc, "left", "a"),
+                          csd_new_string(doc, "right", "d"),
+                          csd_new_string(doc, "confirm", "e"),
+                          csd_new_string(doc, "pause", "p")));
 }
 
 void csd_test_parse_game(void)
@@ -118,9 +156,1367 @@ void csd_test_parse_game(void)
                           csd_new_string(&doc, "pause", "p")));
 
     csd_test_parse(csd_game_source, &doc);
+    csd_free(&doc);
+}
+
+void csd_test_parse_tape(void)
+{
+    const char *sources[] = {csd_game_source, csd_dialog_source, csd_features_source,
+                             csd_mixed_source};
+
+    /* the tape replays the scanner, both parses build the same tree */
+    for (size_t i = 0; i < csd_array_sizeof(sources); i++) {
+        csd_document expected = csd_parse(strdup(sources[i]));
+        csd_document got = csd_parse_x(strdup(sources[i]), csd_parse_tape);
+        TEST_CHECK_(!got.error, "source %zu: %s", i, got.reason);
+
+        csd_neq_status status = {0};
+        csd_eq_x(expected.head, got.head, &csd_node_neq_cb, &status);
+        TEST_CHECK_(!status.has_neq, "source %zu: %s", i, status.why);
+        csd_free(&got);
+        csd_free(&expected);
+    }
+}
+
+void csd_test_parse_keys(void)
+{
+    char source[1024] = "{\n";
+    size_t length = strlen(source);
+    for (int i = 0; i < 32; i++)
+        length +=
+            snprintf(source + length, sizeof source - length, "  key_%d: %d,\n", i, i);
+    snprintf(source + length, sizeof source - length,
+             "  key_7: 'again',\n  _under_score9: true\n}");
+
+    csd_document got = csd_parse(strdup(source));
+    TEST_CHECK_(!got.error, "%s", got.reason);
+    TEST_CHECK(csd_count(got.head) == 33);
+
+    char key[32];
+    for (int i = 0; i < 32; i++) {
+        sprintf(key, "key_%d", i);
+        csd_node *node = csd_at(got.head, key);
+        TEST_CHECK_(node != NULL, "%s", key);
+        if (node && i != 7)
+            TEST_CHECK(node->value.as_int == i);
+    }
+    TEST_CHECK(csd_test_string(&got, csd_at(got.head, "key_7"), "again"));
+    TEST_CHECK(csd_at(got.head, "_under_score9")->value.as_boolean);
+    TEST_CHECK(csd_at(got.head, "key_32") == NULL);
+    TEST_CHECK(csd_at(got.head, "key_") == NULL);
+
+    csd_remove(got.head, "key_3");
+    TEST_CHECK(csd_at(got.head, "key_3") == NULL);
+    TEST_CHECK(csd_at(got.head, "key_31")->value.as_int == 31);
+    csd_free(&got);
+}
+
+void csd_test_parse_error(void)
+{
+    const char *source = "{\n  a: 1,\n  # comment #\n  b: [1, 2,, 3]\n}";
+    const csd_parse_options options[] = {csd_parse_standard, csd_parse_tape};
+
+    for (size_t i = 0; i < csd_array_sizeof(options); i++) {
+        csd_document got = csd_parse_x(strdup(source), options[i]);
+        TEST_CHECK(got.error == csd_scan_error);
+        TEST_CHECK_(strncmp(got.reason, "(3:11)", 6) == 0, "%s", got.reason);
+        csd_free(&got);
+    }
+}
+
+void csd_test_numbers(void)
+{
+    const struct
+    {
+        const char *text;
+        bool ok;
+        double value;
+    } floats[] = {
+        {"6.02214076e23", true, 6.02214076e23},
+        {"-0.0", true, -0.0},
+        {"1e-400", true, 0.0},
+        {"1e400", false, 0.0},
+        {"1e", false, 0.0},
+        /* more digits than Eisel-Lemire keeps, rounded by the exact fallback */
+        {"9007199254740993.0000000000000000000001", true, 0x1.0000000000001p53},
+        {"9007199254740992.9999999999999999999999", true, 0x1p53},
+        {"2.4703282292062327209e-324", true, 0x0.0000000000001p-1022},
+        {"1797693134862315708145274237317043567980705675258449965989174768e245", true,
+         0x1.fffffffffffffp1023},
+    };
+
+    for (size_t i = 0; i < csd_array_sizeof(floats); i++) {
+        double v = 0;
+        bool ok = csd_float_from_chars(floats[i].text, strlen(floats[i].text), &v);
+        TEST_CHECK_(ok == floats[i].ok, "%s", floats[i].text);
+        if (ok && floats[i].ok)
+            TEST_CHECK_(!memcmp(&v, &floats[i].value, sizeof(v)), "%s: %a",
+                        floats[i].text, v);
+    }
+
+    int64_t v;
+    TEST_CHECK(csd_int_from_chars("0x7f", 4, &v) && v == 0x7f);
+    TEST_CHECK(csd_int_from_chars("-0b101", 6, &v) && v == -5);
+    TEST_CHECK(csd_int_from_chars("-9223372036854775808", 20, &v) && v == INT64_MIN);
+    TEST_CHECK(!csd_int_from_chars("9223372036854775808", 19, &v));
+}
+
+void csd_test_parse_slice(void)
+{
+    const char *frames = "{a: 'x\\'y', b: true}{c: 12}{d: tru}";
+    const struct
+    {
+        size_t offset;
+        size_t size;
+        csd_error error;
+    } slices[] = {
+        {0, 20, csd_ok},        {20, 7, csd_ok},        {27, 8, csd_scan_error},
+        {0, 8, csd_scan_error}, {20, 6, csd_scan_error}, {20, 5, csd_scan_error},
+        {0, 16, csd_scan_error},
+    };
+
+    for (size_t i = 0; i < csd_array_sizeof(slices); i++) {
+        /* exactly sized, so reading past the slice is caught by sanitizers */
+        char *frame = malloc(slices[i].size);
+        memcpy(frame, &frames[slices[i].offset], slices[i].size);
+
+        csd_document got = csd_parse_n(frame, slices[i].size, csd_parse_standard);
+        TEST_CHECK_(got.error == slices[i].error, "slice %zu: %s", i, got.reason);
+        TEST_CHECK(memcmp(frame, &frames[slices[i].offset], slices[i].size) == 0);
+        csd_free(&got);
+        free(frame);
+    }
+
+    csd_document got = csd_parse_n(frames, 20, csd_parse_tape);
+    TEST_CHECK(csd_test_string(&got, csd_at(got.head, "a"), "x'y"));
+    TEST_CHECK(csd_at(got.head, "b")->value.as_boolean);
+    csd_free(&got);
+}
+
+void csd_test_parse_borrowed(void)
+{
+    const char *source = "{plain: 'Tetris, a game of falling blocks', "
+                         "escaped: 'line\\none\\t\\\\ of falling blocks', empty: '', "
+                         "yes: 'Yes', tab: 'a\\tb'}";
+    const csd_parse_options options[] = {csd_parse_standard, csd_parse_tape};
+
+    for (size_t i = 0; i < csd_array_sizeof(options); i++) {
+        csd_document got = csd_parse_n(source, strlen(source), options[i]);
+        TEST_CHECK_(!got.error, "%s", got.reason);
+
+        /* escape-free strings are spans of the source, escaped ones decode once */
+        csd_node *plain = csd_at(got.head, "plain");
+        csd_node *escaped = csd_at(got.head, "escaped");
+        TEST_CHECK(csd_raw_string(&plain->value).data == strstr(source, "Tetris"));
+        TEST_CHECK(csd_raw_string(&escaped->value).escaped);
+        TEST_CHECK(csd_test_string(&got, plain, "Tetris, a game of falling blocks"));
+        TEST_CHECK(csd_test_string(&got, escaped, "line\none\t\\ of falling blocks"));
+        TEST_CHECK(!csd_raw_string(&escaped->value).escaped);
+        TEST_CHECK(csd_str(&got, escaped).data == csd_raw_string(&escaped->value).data);
+        TEST_CHECK(csd_test_string(&got, csd_at(got.head, "empty"), ""));
+
+        /* short strings are copied in the value, and decoded there on access */
+        csd_node *yes = csd_at(got.head, "yes");
+        csd_node *tab = csd_at(got.head, "tab");
+        const char *data = csd_raw_string(&yes->value).data;
+        TEST_CHECK(data < source || data >= source + strlen(source));
+        TEST_CHECK(csd_test_string(&got, yes, "Yes"));
+        TEST_CHECK(csd_raw_string(&tab->value).escaped);
+        data = csd_raw_string(&tab->value).data;
+        TEST_CHECK(csd_test_string(&got, tab, "a\tb"));
+        TEST_CHECK(!csd_raw_string(&tab->value).escaped);
+        TEST_CHECK(csd_raw_string(&tab->value).data == data);
+        csd_free(&got);
+    }
+
+    csd_document in_place = csd_parse(strdup(source));
+    csd_document borrowed = csd_parse_n(source, strlen(source), csd_parse_standard);
+    TEST_CHECK(csd_eq(in_place.head, borrowed.head));
+
+    char written[256];
+    csd_write_string(written, sizeof(written), csd_at(borrowed.head, "escaped"),
+                     csd_format_standard);
+    TEST_CHECK_(strcmp(written, "escaped: \"line\\none\\t\\\\ of falling blocks\"") == 0,
+                "%s", written);
+    csd_free(&in_place);
+    csd_free(&borrowed);
+}
+
+void csd_test_write_file(const char *path, const char *source, size_t repeat)
+{
+    FILE *f = fopen(path, "wb");
+    fputs("{\n", f);
+    for (size_t i = 0; i < repeat; i++)
+        fprintf(f, "record_%zu: '%s',\n", i, source);
+    fprintf(f, "game {\n%s\n}\n}", csd_game_source);
+    fclose(f);
+}
+
+void csd_test_parse_file(void)
+{
+    const char *path = "csd_test_file.sd";
+    csd_document expected = {0};
+    expected.head = csd_test_game(&expected);
+
+    /* a small file is read, a large one is mapped */
+    const size_t repeats[] = {0, 1 << 16};
+    for (size_t i = 0; i < csd_array_sizeof(repeats); i++) {
+        csd_test_write_file(path, "escaped \\'quote\\'", repeats[i]);
+        csd_document got = csd_parse_file(path);
+        if (!TEST_CHECK_(!got.error, "%s", got.reason))
+            continue;
+        TEST_CHECK(csd_count(got.head) == repeats[i] + 1);
+        csd_node *game = csd_at(got.head, "game");
+        TEST_CHECK(csd_eq(expected.head, csd_at(game, "tetris")));
+        if (repeats[i]) {
+            TEST_CHECK(got._source_kind == csd_source_mapped);
+            csd_node *last = csd_at(got.head, "record_65535");
+            TEST_CHECK(csd_test_string(&got, last, "escaped 'quote'"));
+        }
+        csd_free(&got);
+    }
+    remove(path);
+    csd_free(&expected);
+
+    csd_document missing = csd_parse_file("csd_test_missing.sd");
+    TEST_CHECK(missing.error == csd_file_error);
+    TEST_CHECK_(strstr(missing.reason, "csd_test_missing.sd") != NULL, "%s",
+                missing.reason);
+    csd_free(&missing);
+}
+
+void csd_test_parse_stream(void)
+{
+#ifdef __unix__
+    /* pipes cannot seek, the stream is read in chunks until eof */
+    int fds[2];
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_ASSERT(write(fds[1], csd_game_source, strlen(csd_game_source)) > 0);
+    close(fds[1]);
+
+    FILE *f = fdopen(fds[0], "rb");
+    csd_document got = csd_parse_stream(f);
+    fclose(f);
+    TEST_CHECK_(!got.error, "%s", got.reason);
+
+    csd_document expected = {0};
+    expected.head = csd_test_game(&expected);
+    TEST_CHECK(csd_eq(expected.head, got.head));
+    csd_free(&expected);
+    csd_free(&got);
+#endif
+}
+
+char *csd_test_records(int records, bool array, int broken);
+
+csd_document csd_test_feed(const char *source, size_t chunk)
+{
+    csd_parser p;
+    csd_parser_init(&p);
+
+    size_t size = strlen(source);
+    for (size_t at = 0; at < size; at += chunk) {
+        if (csd_parser_feed(&p, &source[at], size - at < chunk ? size - at : chunk))
+            break;
+    }
+    return csd_parser_finish(&p);
+}
+
+void csd_test_parser_chunks(void)
+{
+    const char *sources[] = {csd_game_source, csd_features_source, csd_mixed_source};
+    const size_t chunks[] = {1, 2, 3, 5, 7, 16, 64, 4096};
+
+    for (size_t i = 0; i < csd_array_sizeof(sources); i++) {
+        csd_document expected = csd_parse(strdup(sources[i]));
+        TEST_CHECK_(!expected.error, "%s", expected.reason);
+
+        for (size_t j = 0; j < csd_array_sizeof(chunks); j++) {
+            csd_document got = csd_test_feed(sources[i], chunks[j]);
+            TEST_CHECK_(!got.error, "source %zu, chunk %zu: %s", i, chunks[j], got.reason);
+
+            csd_neq_status status = {0};
+            csd_eq_x(expected.head, got.head, &csd_node_neq_cb, &status);
+            TEST_CHECK_(!status.has_neq, "source %zu, chunk %zu: %s", i, chunks[j],
+                        status.why);
+            csd_free(&got);
+        }
+        csd_free(&expected);
+    }
+}
+
+void csd_test_parser_errors(void)
+{
+    const char *sources[] = {
+        "{\n  a: 1,\n  b: ]\n}", "{\n  a: 'open\n}", "{\n  a: 1\n", "{ a: 12e }",
+    };
+
+    for (size_t i = 0; i < csd_array_sizeof(sources); i++) {
+        csd_document expected = csd_parse(strdup(sources[i]));
+        TEST_CHECK(expected.error != csd_ok);
+
+        for (size_t chunk = 1; chunk <= 4; chunk++) {
+            csd_document got = csd_test_feed(sources[i], chunk);
+            TEST_CHECK(got.error == expected.error);
+            TEST_CHECK_(strcmp(got.reason, expected.reason) == 0, "'%s' != '%s'",
+                        got.reason, expected.reason);
+            csd_free(&got);
+        }
+        csd_free(&expected);
+    }
+
+    /* consumed blocks are dropped between chunks, positions still count from the start */
+    char *records = csd_test_records(2000, false, 1500);
+    csd_document expected = csd_parse_n(records, strlen(records), csd_parse_standard);
+    const size_t chunks[] = {1, 7, 64, 1000};
+    for (size_t i = 0; i < csd_array_sizeof(chunks); i++) {
+        csd_document got = csd_test_feed(records, chunks[i]);
+        TEST_CHECK(expected.error == csd_scan_error && got.error == expected.error);
+        TEST_CHECK_(strcmp(got.reason, expected.reason) == 0, "'%s' != '%s'", got.reason,
+                    expected.reason);
+        csd_free(&got);
+    }
+    csd_free(&expected);
+    free(records);
+
+    csd_document empty = csd_test_feed("  # nothing\n", 1);
+    TEST_CHECK(!empty.error && empty.head == NULL);
+}
+
+typedef struct csd_test_trace
+{
+    char events[512];
+    size_t values;
+    char last_key[32];
+    char reason[csd_reason_size];
+} csd_test_trace;
+
+void csd_test_event(void *user, const char *format, ...)
+{
+    csd_test_trace *t = user;
+    size_t length = strlen(t->events);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(t->events + length, sizeof(t->events) - length, format, args);
+    va_end(args);
+}
+
+void csd_test_on_key(void *user, const char *key, size_t size)
+{
+    csd_test_trace *t = user;
+    snprintf(t->last_key, sizeof(t->last_key), "%.*s", (int)size, key);
+    csd_test_event(t, "%s:", t->last_key);
+}
+
+void csd_test_on_value(void *user, csd_value value)
+{
+    ((csd_test_trace *)user)->values++;
+    switch (value.type) {
+    case csd_type_string: {
+        csd_string s = csd_raw_string(&value);
+        csd_test_event(user, "'%.*s' ", (int)s.size, s.data);
+    } break;
+    case csd_type_int:
+        csd_test_event(user, "%lld ", (long long)value.as_int);
+        break;
+    case csd_type_float:
+        csd_test_event(user, "%g ", value.as_float);
+        break;
+    case csd_type_boolean:
+        csd_test_event(user, value.as_boolean ? "true " : "false ");
+        break;
+    default:
+        csd_test_event(user, "? ");
+        break;
+    }
+}
+
+void csd_test_on_sequence_begin(void *user)
+{
+    csd_test_event(user, "{ ");
+}
+
+void csd_test_on_sequence_end(void *user)
+{
+    csd_test_event(user, "} ");
+}
+
+void csd_test_on_array_begin(void *user)
+{
+    csd_test_event(user, "[ ");
+}
+
+void csd_test_on_array_end(void *user)
+{
+    csd_test_event(user, "] ");
+}
+
+void csd_test_on_error(void *user, csd_error error, const char *reason)
+{
+    (void)error;
+    snprintf(((csd_test_trace *)user)->reason, csd_reason_size, "%s", reason);
+}
+
+static const csd_handler csd_test_handler = {
+    .on_key = &csd_test_on_key,
+    .on_value = &csd_test_on_value,
+    .on_sequence_begin = &csd_test_on_sequence_begin,
+    .on_sequence_end = &csd_test_on_sequence_end,
+    .on_array_begin = &csd_test_on_array_begin,
+    .on_array_end = &csd_test_on_array_end,
+    .on_error = &csd_test_on_error,
+};
+
+void csd_test_parse_events(void)
+{
+    const char *source = "{ # comment #\n name: 'a\\'b', size: [1, 2.5, [true]], "
+                         "window { w: 0x10 } { } }";
+    csd_test_trace trace = {0};
+    TEST_CHECK(csd_parse_events(source, &csd_test_handler, &trace) == csd_ok);
+    TEST_CHECK_(strcmp(trace.events, ":{ name:'a\\'b' size:[ 1 2.5 [ true ] ] "
+                                     "window:{ w:16 } :{ } } ") == 0,
+                "%s", trace.events);
+
+    /* callbacks left NULL are skipped */
+    csd_handler values_only = {.on_value = &csd_test_on_value};
+    csd_test_trace values = {0};
+    TEST_CHECK(csd_parse_events(source, &values_only, &values) == csd_ok);
+    TEST_CHECK(values.values == 5 && values.events[0] != '{');
+
+    const char *errors[] = {"{\n  a: 1,\n  b: ]\n}", "{\n  a: 'open\n}", "{ a: 12e }"};
+    for (size_t i = 0; i < csd_array_sizeof(errors); i++) {
+        csd_document expected = csd_parse(strdup(errors[i]));
+        csd_test_trace got = {0};
+        csd_error error = csd_parse_events(errors[i], &csd_test_handler, &got);
+        TEST_CHECK(error == expected.error);
+        TEST_CHECK_(strcmp(got.reason, expected.reason) == 0, "'%s' != '%s'", got.reason,
+                    expected.reason);
+        csd_free(&expected);
+    }
+
+    /* the index is classified a window at a time, well past its first window */
+    const int records = 1 << 14;
+    char *large = malloc(64 * records);
+    size_t size = sprintf(large, "{");
+    for (int i = 0; i < records; i++)
+        size += sprintf(&large[size], "record_%d: ['text \\'%d\\'', %d],\n", i, i, i);
+    size += sprintf(&large[size], "}");
+
+    csd_test_trace big = {0};
+    TEST_CHECK(csd_parse_events_n(large, size, &csd_test_handler, &big) == csd_ok);
+    TEST_CHECK(big.values == 2 * (size_t)records);
+    TEST_CHECK_(strcmp(big.last_key, "record_16383") == 0, "%s", big.last_key);
+    free(large);
+}
+
+void csd_test_cursor(void)
+{
+    const int records = 1 << 12;
+    char *source = malloc(96 * records);
+    size_t size = sprintf(source, "{ name: 'scores', records: [");
+    for (int i = 0; i < records; i++)
+        size += sprintf(&source[size], "{ id: %d, tags: ['a', 'b'] }, [%d], ", i, -i);
+    size += sprintf(&source[size], "], end: true }");
+
+    csd_cursor c;
+    csd_cursor_open(&c, source, size);
+    TEST_ASSERT(csd_cursor_enter(&c) && strcmp(c.key, "") == 0);
+    csd_node *name = csd_cursor_next_value(&c);
+    TEST_CHECK(csd_test_string(&c.doc, name, "scores"));
+    TEST_ASSERT(csd_cursor_enter(&c) && strcmp(c.key, "records") == 0);
+
+    /* each record lives in the cursor document until the next call */
+    int read = 0;
+    for (int i = 0; i < records; i++) {
+        csd_node *record = csd_cursor_next_value(&c);
+        if (!TEST_CHECK_(record != NULL, "%s", c.doc.reason))
+            break;
+        read += csd_at(record, "id")->value.as_int == i;
+        TEST_CHECK(csd_cursor_skip(&c));
+    }
+    TEST_CHECK(read == records);
+    TEST_CHECK(csd_cursor_next_value(&c) == NULL && !c.doc.error);
+
+    csd_node *end = csd_cursor_next_value(&c);
+    TEST_CHECK(end && strcmp(end->key, "end") == 0 && end->value.as_boolean);
+    TEST_CHECK(csd_cursor_next_value(&c) == NULL && !csd_cursor_enter(&c));
+    TEST_CHECK(!c.doc.error);
+    csd_cursor_close(&c);
+    free(source);
+
+    const char *nested = "{ a { b: [1, [2, 3]] } c: 4 }";
+    csd_cursor_open(&c, nested, strlen(nested));
+    TEST_CHECK(csd_cursor_enter(&c) && csd_cursor_enter(&c) && csd_cursor_enter(&c));
+    TEST_CHECK(csd_cursor_skip(&c) && csd_cursor_skip(&c) && !csd_cursor_skip(&c));
+    TEST_CHECK(!csd_cursor_skip(&c));
+    csd_node *last = csd_cursor_next_value(&c);
+    TEST_CHECK(last && strcmp(last->key, "c") == 0 && last->value.as_int == 4);
+    TEST_CHECK(csd_cursor_next_value(&c) == NULL && !c.doc.error);
+    TEST_CHECK(!csd_cursor_enter(&c) && !c.doc.error);
+
+    /* only containers can be entered */
+    csd_cursor_close(&c);
+    csd_cursor_open(&c, nested, strlen(nested));
+    TEST_CHECK(csd_cursor_enter(&c) && csd_cursor_enter(&c) && csd_cursor_enter(&c));
+    TEST_CHECK(!csd_cursor_enter(&c) && !csd_cursor_next_value(&c));
+    TEST_CHECK(c.doc.error == csd_scan_error);
+    TEST_CHECK_(strstr(c.doc.reason, "expected: '{', '['") != NULL, "%s", c.doc.reason);
+    csd_cursor_close(&c);
+}
+
+void csd_test_parse_lazy(void)
+{
+    csd_document eager = csd_parse(strdup(csd_features_source));
+    csd_document doc = csd_parse_lazy(csd_features_source, strlen(csd_features_source));
+    TEST_ASSERT_(!eager.error, "%s", eager.reason);
+
+    csd_lazy root = csd_lazy_root(&doc);
+    TEST_CHECK(root.ok && root.type == csd_type_sequence);
+    TEST_CHECK(csd_lazy_len(root) == csd_count(eager.head));
+
+    /* values are parsed only when read, in any order */
+    csd_lazy gray = csd_lazy_at(csd_lazy_at(root, "colors"), "gray");
+    TEST_CHECK(gray.type == csd_type_array && csd_lazy_len(gray) == 3);
+    TEST_CHECK(csd_lazy_value(csd_lazy_index(gray, 2)).as_int == 128);
+    TEST_CHECK(!csd_lazy_index(gray, 3).ok);
+
+    for (size_t i = 0; i < csd_count(eager.head); i++) {
+        csd_node *node = eager.head->value.as_sequence[i].value;
+        csd_lazy v = csd_lazy_at(root, node->key);
+        TEST_CHECK_(v.ok && v.type == node->value.type, "%s", node->key);
+        csd_node *lazy = csd_new_nil(&doc, node->key);
+        lazy->value = csd_lazy_value(v);
+        TEST_CHECK_(csd_eq(node, lazy), "%s", node->key);
+    }
+    TEST_CHECK(!csd_lazy_at(root, "missing").ok && !doc.error);
+    TEST_CHECK(!csd_lazy_at(gray, "gray").ok && !csd_lazy_index(root, 0).ok);
+
+    /* a walk visits the elements in order, nested sequences need no comma */
+    size_t count = 0;
+    for (csd_lazy v = csd_lazy_first(root); v.ok; v = csd_lazy_next(v), count++) {
+        csd_node *node = eager.head->value.as_sequence[count].value;
+        TEST_CHECK_(v.type == node->value.type, "%s", node->key);
+    }
+    TEST_CHECK(count == csd_count(eager.head) && !doc.error);
+    TEST_CHECK(!csd_lazy_next(root).ok && !csd_lazy_first(csd_lazy_index(gray, 0)).ok);
+    csd_free(&eager);
+    csd_free(&doc);
+
+    /* a large array is walked in one pass, indexing each item would be quadratic */
+    const int items = 200000;
+    char *numbers = malloc(16 * (size_t)items + 32);
+    size_t size = sprintf(numbers, "numbers: [");
+    for (int i = 0; i < items; i++)
+        size += sprintf(&numbers[size], "%d, ", i);
+    sprintf(&numbers[size], "'end']");
+    doc = csd_parse_lazy(numbers, strlen(numbers));
+    csd_lazy array = csd_lazy_root(&doc);
+    csd_lazy v = csd_lazy_first(array);
+    int walked = 0;
+    for (; v.ok && v.type == csd_type_int; v = csd_lazy_next(v), walked++) {
+        if (csd_lazy_value(v).as_int != walked)
+            break;
+    }
+    TEST_CHECK_(walked == items, "%d items walked", walked);
+    TEST_CHECK(v.type == csd_type_string && !csd_lazy_next(v).ok && !doc.error);
+
+    /* the index is a window following the reads, going back classifies it again */
+    TEST_CHECK(doc._scanner->index.first > 0);
+    TEST_CHECK(csd_lazy_value(csd_lazy_index(array, 5)).as_int == 5);
+    csd_free(&doc);
+    free(numbers);
+
+    /* unread subtrees are only bracket matched, errors surface on the path read */
+    const char *broken = "{ first: 1, skipped: [1, 'a' 2], last { deep: 1e999 } }";
+    doc = csd_parse_lazy(broken, strlen(broken));
+    root = csd_lazy_root(&doc);
+    TEST_CHECK(csd_lazy_value(csd_lazy_at(root, "first")).as_int == 1);
+    csd_lazy deep = csd_lazy_at(csd_lazy_at(root, "last"), "deep");
+    TEST_CHECK(deep.ok && !doc.error);
+    TEST_CHECK(csd_lazy_value(deep).type == csd_type_nil && doc.error == csd_scan_error);
+    TEST_CHECK_(strstr(doc.reason, "float out of range") != NULL, "%s", doc.reason);
+    TEST_CHECK(!csd_lazy_at(root, "first").ok);
+    csd_free(&doc);
+}
+
+void csd_test_parse_select(void)
+{
+    const char *game_paths[] = {"tetris.window.width", "tetris.controls"};
+    csd_document game = csd_parse_select(csd_game_source, game_paths, 2);
+    TEST_ASSERT_(!game.error, "%s", game.reason);
+    csd_node *window = csd_at(game.head, "window");
+    TEST_CHECK(csd_count(game.head) == 2 && csd_count(window) == 1);
+    TEST_CHECK(csd_at(window, "width")->value.as_int == 1920);
+    TEST_CHECK(csd_count(csd_at(game.head, "controls")) == 4);
+    csd_free(&game);
+
+    /* strings and comments holding brackets are skipped whole */
+    const char *mixed_paths[] = {"items[2].x", "nested.deep", "items[0]", "missing.key"};
+    const char *source = "{ a: '{[', b: ['}', # ]\n 1], items: [1, [2, 3], {x: 'y', w: 0}],"
+                         " nested { deep { deeper: 1 } } tail: 'end' }";
+    csd_document got = csd_parse_select(source, mixed_paths, 4);
+    TEST_ASSERT_(!got.error, "%s", got.reason);
+    TEST_CHECK(csd_count(got.head) == 2);
+    csd_node *items = csd_at(got.head, "items");
+    TEST_CHECK(csd_len(items) == 3 && items->value.as_array[0].as_int == 1);
+    TEST_CHECK(items->value.as_array[1].type == csd_type_nil);
+    csd_sequence item = items->value.as_array[2].as_sequence;
+    TEST_CHECK(csd_sequence_count(&item) == 1);
+    TEST_CHECK(csd_test_string(&got, csd_sequence_get(&item, "x"), "y"));
+    csd_node *deep = csd_at(csd_at(got.head, "nested"), "deep");
+    TEST_CHECK(csd_at(deep, "deeper")->value.as_int == 1);
+    csd_free(&got);
+
+    const char *colors[] = {"colors.gray[1]"};
+    got = csd_parse_select(csd_features_source, colors, 1);
+    TEST_CHECK_(!got.error, "%s", got.reason);
+    TEST_CHECK(csd_len(csd_at(csd_at(got.head, "colors"), "gray")) == 2);
+    csd_free(&got);
+
+    const char *bad[] = {"tetris..window"};
+    got = csd_parse_select(csd_game_source, bad, 1);
+    TEST_CHECK(got.error == csd_scan_error);
+    TEST_CHECK_(strcmp(got.reason, "path 'tetris..window': expected a key") == 0, "%s",
+                got.reason);
+    csd_free(&got);
+
+    /* an index is plain decimal digits */
+    const char *indices[] = {"items[-1]", "items[ 2]", "items[+2]", "items[0x1]",
+                             "items[]", "items[2", "items[99999999999999999999]"};
+    for (size_t i = 0; i < csd_array_sizeof(indices); i++) {
+        got = csd_parse_select(csd_features_source, &indices[i], 1);
+        TEST_CHECK(got.error == csd_scan_error);
+        TEST_CHECK_(strstr(got.reason, "expected an index") != NULL, "%s", got.reason);
+        csd_free(&got);
+    }
+
+    const char *unterminated = "{ a: 1, b: ['] }";
+    got = csd_parse_select(unterminated, game_paths, 1);
+    TEST_CHECK(got.error == csd_scan_error && got.head == NULL);
+    TEST_CHECK_(strstr(got.reason, "unterminated string") != NULL, "%s", got.reason);
+    csd_free(&got);
+}
+
+char *csd_test_records(int records, bool array, int broken)
+{
+    char *source = malloc(160 * (size_t)records + 64);
+    size_t size = sprintf(source, array ? "records: [ # '[' \n" : "{ # '{' \n");
+
+    /* brackets, quotes and separators hide in strings and comments */
+    for (int i = 0; i < records; i++) {
+        if (i == broken)
+            size += sprintf(&source[size], "oops ");
+        if (array)
+            size += sprintf(&source[size],
+                            "{id: %d, s: 'a,]\\'}'}, [%d, \"#[\"], 'x\\\\',\n",
+                            i, i);
+        else if (i % 2)
+            size += sprintf(&source[size],
+                            "r%d { s: 'n\\'a,m}e{', t: [\"x]\", 'y#'], # }, '\n v: %d }\n",
+                            i, i);
+        else
+            size += sprintf(&source[size], "l%d: [1, {d: \"a\\\\\"}, ',]'],\n", i);
+    }
+    sprintf(&source[size], array ? "]" : "}");
+    return source;
+}
+
+void csd_test_parse_parallel(void)
+{
+    const int threads[] = {2, 3, 7, 16};
+
+    for (int kind = 0; kind < 2; kind++) {
+        char *source = csd_test_records(20000, kind, -1);
+        csd_document expected = csd_parse_n(source, strlen(source), csd_parse_standard);
+        TEST_ASSERT_(!expected.error, "%s", expected.reason);
+
+        for (size_t i = 0; i < csd_array_sizeof(threads); i++) {
+            csd_parse_options options = {.threads = threads[i]};
+            csd_document got = csd_parse_n(source, strlen(source), options);
+            TEST_CHECK_(!got.error, "%d threads: %s", threads[i], got.reason);
+            TEST_CHECK_(csd_eq(expected.head, got.head), "%d threads", threads[i]);
+            csd_free(&got);
+        }
+
+        /* the owned source is not decoded in place by the chunks */
+        csd_parse_options options = {.threads = 4};
+        csd_document owned = csd_parse_x(strdup(source), options);
+        TEST_CHECK(csd_eq(expected.head, owned.head));
+        csd_free(&owned);
+
+        /* a pool is reused across parses, sources too small to split parse alone */
+        csd_pool *pool = csd_pool_new(4, NULL);
+        for (int run = 0; run < 2; run++) {
+            csd_parse_options pooled = {.pool = pool};
+            csd_document got = csd_parse_n(source, strlen(source), pooled);
+            TEST_CHECK(csd_eq(expected.head, got.head));
+            csd_free(&got);
+        }
+        const char *window = "window { title: 'tetris', sizes: [1, 2, 3] }";
+        csd_document alone = csd_parse_n(window, strlen(window), csd_parse_standard);
+        csd_parse_options small[] = {{.threads = 4}, {.pool = pool}};
+        for (size_t i = 0; i < csd_array_sizeof(small); i++) {
+            csd_document got = csd_parse_n(window, strlen(window), small[i]);
+            TEST_CHECK_(!got.error, "%s", got.reason);
+            TEST_CHECK(csd_eq(alone.head, got.head));
+            csd_free(&got);
+        }
+        csd_free(&alone);
+        csd_pool_free(pool);
+        csd_free(&expected);
+        free(source);
+    }
+
+    /* a root array of ints is packed like a sequential parse packs it */
+    size_t count = 200000;
+    char *numbers = malloc(count * 8 + 16);
+    char *at = numbers + sprintf(numbers, "numbers: [");
+    for (size_t i = 0; i < count; i++)
+        at += sprintf(at, "%zu%s\n", i % 100000, i + 1 < count ? "," : "");
+    strcpy(at, "]");
+    csd_parse_options packed = {.threads = 4, .packed_arrays = true};
+    csd_document unboxed = csd_parse_n(numbers, strlen(numbers), packed);
+    TEST_ASSERT_(!unboxed.error, "%s", unboxed.reason);
+    size_t len;
+    int64_t *ints = csd_array_as_int64(unboxed.head, &len);
+    TEST_CHECK_(ints && len == count, "%zu ints", len);
+    TEST_CHECK(ints && ints[count - 1] == (int64_t)((count - 1) % 100000));
+    csd_free(&unboxed);
+    free(numbers);
+
+    /* errors are those of the sequential parse */
+    char *broken = csd_test_records(20000, false, 12345);
+    csd_document expected = csd_parse_n(broken, strlen(broken), csd_parse_standard);
+    csd_parse_options options = {.threads = 8};
+    csd_document got = csd_parse_n(broken, strlen(broken), options);
+    TEST_CHECK(expected.error == csd_scan_error && got.error == expected.error);
+    TEST_CHECK_(strcmp(got.reason, expected.reason) == 0, "'%s' != '%s'", got.reason,
+                expected.reason);
+    csd_free(&expected);
+    csd_free(&got);
+    free(broken);
+}
+
+void csd_test_parse_batch(void)
+{
+    const char *sources[] = {
+        "tetris { width: 10, height: 20 }",
+        "colors: [0x80, 'gray', true]",
+        "broken { width: }",
+        "",
+        "id: 'sc\\'ore'",
+    };
+    const size_t n = 200;
+    csd_input *inputs = malloc(n * sizeof(*inputs));
+    csd_document *docs = malloc(n * sizeof(*docs));
+    for (size_t i = 0; i < n; i++) {
+        const char *source = sources[i % csd_array_sizeof(sources)];
+        inputs[i] = (csd_input){source, strlen(source)};
+    }
+
+    /* the pool is reused across batches, a null pool parses on the calling thread */
+    csd_pool *pool = csd_pool_new(4, NULL);
+    csd_pool *pools[] = {pool, pool, NULL};
+    for (size_t p = 0; p < csd_array_sizeof(pools); p++) {
+        size_t failed = csd_parse_batch(inputs, n, docs, pools[p], csd_parse_standard);
+        TEST_CHECK_(failed == n / csd_array_sizeof(sources), "%zu failed", failed);
+
+        for (size_t i = 0; i < n; i++) {
+            csd_document expected =
+                csd_parse_n(inputs[i].source, inputs[i].size, csd_parse_standard);
+            TEST_CHECK_(docs[i].error == expected.error, "document %zu", i);
+            if (expected.error)
+                TEST_CHECK(strcmp(docs[i].reason, expected.reason) == 0);
+            TEST_CHECK_(csd_eq(docs[i].head, expected.head), "document %zu", i);
+            csd_free(&expected);
+            csd_free(&docs[i]);
+        }
+    }
+
+    /* the options apply to every document */
+    const csd_input options_inputs[] = {
+        {"ints: [1, 2, 3]", 15},
+        {"deep { a { b { c: 1 } } }", 25},
+    };
+    csd_parse_options options = {.max_depth = 2, .packed_arrays = true};
+    size_t failed = csd_parse_batch(options_inputs, 2, docs, pool, options);
+    size_t len;
+    TEST_CHECK(failed == 1 && strstr(docs[1].reason, "maximum depth"));
+    TEST_CHECK(csd_array_as_int64(docs[0].head, &len) && len == 3);
+    csd_free(&docs[0]);
+    csd_free(&docs[1]);
+
+    csd_pool_free(pool);
+    free(inputs);
+    free(docs);
+}
+
+typedef struct csd_test_nested
+{
+    csd_pool *pool;
+    const char *source;
+    csd_node *expected;
+    int calls;
+    int refused;
+    int failed;
+} csd_test_nested;
+
+/* an allocator that parses, called from the jobs of a pool */
+static void *csd_test_nested_alloc(void *user, size_t size)
+{
+    csd_test_nested *nested = user;
+    csd_input input = {nested->source, strlen(nested->source)};
+    csd_parse_options options = {.pool = nested->pool, .threads = 4};
+    csd_document docs[2];
+    docs[0] = csd_parse_n(input.source, input.size, options);
+    if (nested->pool)
+        csd_parse_batch(&input, 1, &docs[1], nested->pool, options);
+    for (int i = 0; i < (nested->pool ? 2 : 1); i++) {
+        bool refused = docs[i].error == csd_pool_error && !docs[i].head;
+        bool parsed = !docs[i].error && csd_eq(nested->expected, docs[i].head);
+        __atomic_fetch_add(&nested->refused, refused, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&nested->failed, !refused && !parsed, __ATOMIC_RELAXED);
+        csd_free(&docs[i]);
+    }
+    __atomic_fetch_add(&nested->calls, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void *csd_test_nested_realloc(void *user, void *p, size_t size)
+{
+    (void)user;
+    return realloc(p, size);
+}
+
+static void csd_test_nested_free(void *user, void *p)
+{
+    (void)user;
+    free(p);
+}
+
+void csd_test_pool_nested(void)
+{
+    char *source = csd_test_records(7000, true, -1);
+    csd_input input = {source, strlen(source)};
+    csd_document expected = csd_parse_n(source, input.size, csd_parse_standard);
+    csd_test_nested nested = {.source = source, .expected = expected.head};
+    csd_allocator allocator = {csd_test_nested_alloc, csd_test_nested_realloc,
+                               csd_test_nested_free, &nested};
+
+    /* a job parsing on its own pool fails instead of waiting for itself */
+    nested.pool = csd_pool_new(4, NULL);
+    csd_parse_options options = {.allocator = &allocator};
+    csd_document doc;
+    TEST_CHECK(csd_parse_batch(&input, 1, &doc, nested.pool, options) == 0);
+    TEST_CHECK(csd_eq(expected.head, doc.head));
+    TEST_CHECK(nested.calls > 0 && nested.refused == 2 * nested.calls);
+    TEST_CHECK_(!nested.failed, "%d failed", nested.failed);
+    csd_free(&doc);
+    csd_pool_free(nested.pool);
+
+    /* a job of the shared pool parses its nested documents alone */
+    nested = (csd_test_nested){.source = source, .expected = expected.head};
+    options = (csd_parse_options){.threads = 4, .allocator = &allocator};
+    doc = csd_parse_n(source, input.size, options);
+    TEST_CHECK(csd_eq(expected.head, doc.head));
+    TEST_CHECK(nested.calls > 0 && !nested.refused);
+    TEST_CHECK_(!nested.failed, "%d failed", nested.failed);
+    csd_free(&doc);
+    csd_free(&expected);
+    free(source);
+}
+
+void csd_test_stream_next(void)
+{
+    const char *source = "{id: 1, level: 'a'} # first\n"
+                         "{id: 2, level: 'b\\'c'}{id: 3, level: 'd'}\n"
+                         "tetris { id: 4 } score: 5\n";
+    const char *keys[] = {"", "", "", "tetris", "score"};
+
+    /* each document is a view into the buffer, with reuse its storage is recycled */
+    for (int reuse = 0; reuse < 2; reuse++) {
+        csd_stream s;
+        csd_document doc = {0};
+        csd_stream_open(&s, source, strlen(source), NULL);
+        s.reuse = reuse;
+
+        int count = 0;
+        while (csd_stream_next(&s, &doc)) {
+            TEST_CHECK_(!doc.error, "%s", doc.reason);
+            TEST_CHECK(doc.source == source);
+            if (count < (int)csd_array_sizeof(keys))
+                TEST_CHECK_(strcmp(doc.head->key, keys[count]) == 0, "%d", count);
+            if (count < 3)
+                TEST_CHECK(csd_at(doc.head, "id")->value.as_int == count + 1);
+            if (count == 1)
+                TEST_CHECK(csd_test_string(&doc, csd_at(doc.head, "level"), "b'c"));
+            if (!reuse)
+                csd_free(&doc);
+            count++;
+        }
+        TEST_CHECK_(count == 5, "%d documents", count);
+        csd_stream_close(&s);
+    }
+
+    /* a broken document ends the stream */
+    const char *broken = "{a: 1}\n{b: }\n{c: 3}";
+    csd_stream s;
+    csd_document doc;
+    csd_stream_open(&s, broken, strlen(broken), NULL);
+    TEST_CHECK(csd_stream_next(&s, &doc) && !doc.error);
+    csd_free(&doc);
+    TEST_CHECK(csd_stream_next(&s, &doc) && doc.error == csd_scan_error);
+    TEST_CHECK_(strcmp(doc.reason, s.reason) == 0, "%s", doc.reason);
+    csd_free(&doc);
+    TEST_CHECK(!csd_stream_next(&s, &doc));
+    csd_stream_close(&s);
+
+    /* with reuse the broken document and its reason are released by the next call */
+    csd_document reused;
+    csd_stream_open(&s, broken, strlen(broken), NULL);
+    s.reuse = true;
+    TEST_CHECK(csd_stream_next(&s, &reused) && !reused.error);
+    TEST_CHECK(csd_stream_next(&s, &reused) && reused.error == csd_scan_error);
+    TEST_CHECK(!csd_stream_next(&s, &reused) && !reused.reason && !reused._arena);
+    csd_stream_close(&s);
+
+    const char *path = "csd_test_stream.sd";
+    FILE *f = fopen(path, "wb");
+    for (int i = 0; i < 1000; i++)
+        fprintf(f, "{id: %d}\n", i);
+    fclose(f);
+
+    int count = 0;
+    TEST_CHECK(csd_stream_open_file(&s, path, NULL) == csd_ok);
+    while (csd_stream_next(&s, &doc)) {
+        TEST_CHECK(!doc.error && csd_at(doc.head, "id")->value.as_int == count++);
+        csd_free(&doc);
+    }
+    TEST_CHECK_(count == 1000, "%d documents", count);
+    csd_stream_close(&s);
+    remove(path);
+
+    TEST_CHECK(csd_stream_open_file(&s, path, NULL) == csd_file_error);
+    TEST_CHECK(!csd_stream_next(&s, &doc));
+    csd_stream_close(&s);
+}
+
+char *csd_test_nested_source(size_t depth)
+{
+    char *source = malloc(5 * depth + 16);
+    char *it = source;
+
+    /* alternates sequences and arrays, every level holds a value */
+    it += sprintf(it, "root ");
+    for (size_t i = 0; i < depth; i++)
+        it += sprintf(it, i % 2 ? "[1, " : "{a: ");
+    for (size_t i = depth; i-- > 0;)
+        it += sprintf(it, i % 2 ? "]" : "}");
+    return source;
+}
+
+void csd_test_parse_depth(void)
+{
+    const csd_parse_options options[] = {csd_parse_standard, csd_parse_tape};
+    char *deep = csd_test_nested_source(3 * csd_default_max_depth);
+
+    for (size_t i = 0; i < csd_array_sizeof(options); i++) {
+        csd_document got = csd_parse_n(deep, strlen(deep), options[i]);
+        TEST_CHECK(got.error == csd_scan_error);
+        TEST_CHECK_(strstr(got.reason, "maximum depth of 1024"), "%s", got.reason);
+        csd_free(&got);
+
+        /* the parse stack is not the C stack, a higher limit is only bound by memory */
+        csd_parse_options deeper = options[i];
+        deeper.max_depth = 3 * csd_default_max_depth;
+        got = csd_parse_n(deep, strlen(deep), deeper);
+        TEST_CHECK_(!got.error, "%s", got.reason);
+        size_t depth = 1;
+        csd_value *value = &got.head->value;
+        while (value->type == csd_type_sequence) {
+            value = &csd_sequence_get(&value->as_sequence, "a")->value;
+            TEST_CHECK(value->type == csd_type_array && value->as_array[0].as_int == 1);
+            depth++;
+            if (csd_array_len(&value->as_array) < 2)
+                break;
+            value = &value->as_array[1];
+            depth++;
+        }
+        TEST_CHECK_(depth == 3 * csd_default_max_depth, "depth %zu", depth);
+        csd_free(&got);
+    }
+
+    /* the event and push parsers have the same limit */
+    csd_test_trace trace = {0};
+    TEST_CHECK(csd_parse_events(deep, &csd_test_handler, &trace) == csd_scan_error);
+    TEST_CHECK_(strstr(trace.reason, "maximum depth of 1024"), "%s", trace.reason);
+    csd_parser p;
+    csd_parser_init(&p);
+    TEST_CHECK(csd_parser_feed(&p, deep, strlen(deep)) == csd_scan_error);
+    csd_document got = csd_parser_finish(&p);
+    TEST_CHECK_(strstr(got.reason, "maximum depth of 1024"), "%s", got.reason);
+    csd_free(&got);
+    free(deep);
+
+    char *limit = csd_test_nested_source(csd_default_max_depth - 2);
+    trace = (csd_test_trace){0};
+    TEST_CHECK_(csd_parse_events(limit, &csd_test_handler, &trace) == csd_ok, "%s",
+                trace.reason);
+    TEST_CHECK_(trace.values == csd_default_max_depth / 2 - 1, "%zu values", trace.values);
+    free(limit);
+}
+
+csd_arena *csd_arena_new(const csd_allocator *allocator);
+void *csd_arena_alloc(csd_arena *arena, size_t size);
+size_t csd_arena_used(csd_arena *arena);
+void csd_arena_reset(csd_arena *arena);
+void csd_arena_free(csd_arena **arena);
+
+void csd_test_arena(void)
+{
+    const char *source = "{ colors: [1, 2, 3], window { width: 1920 }, a: 1, b: 2, c: 3, "
+                         "d: 4, e: 5, f: 6, g: 7, h: 8, i: 9, a: 10 }";
+    csd_document doc = csd_parse_n(source, strlen(source), csd_parse_standard);
+    TEST_CHECK_(!doc.error, "%s", doc.reason);
+
+    /* a repeated key replaces the previous one, past the linear search too */
+    TEST_CHECK(csd_count(doc.head) == 11);
+    TEST_CHECK(csd_at(doc.head, "a")->value.as_int == 10);
+
+    /* parsed containers grow in the arena, the nodes already read never move */
+    csd_node *colors = csd_at(doc.head, "colors");
+    csd_node *width = csd_at(csd_at(doc.head, "window"), "width");
+    static char keys[100][16];
+    for (int i = 0; i < 100; i++) {
+        sprintf(keys[i], "key_%d", i);
+        csd_insert(doc.head, csd_new_int(&doc, keys[i], i));
+        csd_push(colors, csd_vint(i));
+    }
+    TEST_CHECK(csd_at(doc.head, "colors") == colors);
+    TEST_CHECK(csd_at(csd_at(doc.head, "window"), "width") == width);
+    TEST_CHECK(csd_at(doc.head, "key_42")->value.as_int == 42);
+    TEST_CHECK(csd_len(colors) == 103 && colors->value.as_array[102].as_int == 99);
+
+    /* heap containers given to the document are moved into its arena */
+    csd_array heap = NULL;
+    csd_array_push(&heap, csd_vint(1));
+    csd_array_push(&heap, csd_varray(NULL));
+    csd_array_push(&heap[1].as_array, csd_vint(2));
+    csd_node *moved = csd_new_array(&doc, "moved", heap);
+    csd_array *nested = &moved->value.as_array[1].as_array;
+    csd_array_push(nested, csd_vint(3));
+    csd_insert(doc.head, moved);
+    TEST_CHECK(csd_len(moved) == 2 && csd_array_len(nested) == 2);
+    TEST_CHECK((*nested)[0].as_int == 2 && (*nested)[1].as_int == 3);
+    csd_free(&doc);
+
+    /* a reset keeps the largest chunk, a capped one allocated after it is smaller */
+    csd_arena *arena = csd_arena_new(NULL);
+    TEST_ASSERT(arena && csd_arena_alloc(arena, 2 * csd_arena_chunk_max));
+    TEST_CHECK(csd_arena_alloc(arena, csd_arena_chunk_max) != NULL);
+    csd_arena_reset(arena);
+    TEST_CHECK(arena->end - arena->at == 2 * csd_arena_chunk_max);
+    TEST_CHECK(csd_arena_used(arena) == 0);
+    csd_arena_free(&arena);
+}
+
+csd_value csd_token_value(csd_document *doc, csd_token vtoken);
+
+void csd_test_value_layout(void)
+{
+    /* the string accessors hide where the size and escape flag are kept */
+    csd_value v = csd_vstring("tetris");
+    csd_string s = csd_raw_string(&v);
+    TEST_CHECK(v.type == csd_type_string && s.size == 6 && !s.escaped);
+    csd_set_string(&v, (csd_string){"te\\ttris", 8, true});
+    s = csd_raw_string(&v);
+    TEST_CHECK(v.type == csd_type_string && s.size == 8 && s.escaped);
+
+    /* a short string is in the value, a copy carries its own bytes */
+    csd_value copy = v;
+    s = csd_raw_string(&copy);
+    TEST_CHECK(s.data == (const char *)&copy && memcmp(s.data, "te\\ttris", 8) == 0);
+
+    v = csd_vint(INT64_MIN);
+    TEST_CHECK(v.type == csd_type_int && v.as_int == INT64_MIN);
+#ifdef csd_wide_values
+    TEST_CHECK(sizeof(csd_value) == sizeof(void *) + sizeof(size_t) + 8);
+#else
+    TEST_CHECK(sizeof(csd_value) == 16);
+
+    /* a string the size cannot hold fails the parse, its bytes are never read */
+    const char *source = "long: 'x'";
+    csd_document doc = {.source = (char *)source, .size = strlen(source),
+                        ._source_kind = csd_source_borrowed};
+    csd_token token = {.type = csd_token_string, .expr = (char *)&source[6],
+                       .size = (size_t)UINT32_MAX + 1, .offset = 6};
+    TEST_CHECK(csd_token_value(&doc, token).type == csd_type_nil);
+    TEST_CHECK(doc.error == csd_scan_error);
+    TEST_CHECK_(strstr(doc.reason, "too long for a value") != NULL, "%s", doc.reason);
+    csd_free(&doc);
+#endif
+}
+
+void csd_test_packed_arrays(void)
+{
+    const char *source = "{ ints: [1, -2, 0x10], floats: [1.5, -2.25], mixed: [1, 2.5], "
+                         "names: ['a'], empty: [], nested: [[1, 2], [3.5]] }";
+    csd_parse_options options = csd_parse_standard;
+    csd_document expected = csd_parse_n(source, strlen(source), options);
+    options.packed_arrays = true;
+
+    for (int tape = 0; tape < 2; tape++) {
+        options.tape = tape;
+        csd_document doc = csd_parse_n(source, strlen(source), options);
+        TEST_CHECK_(!doc.error, "%s", doc.reason);
+        TEST_CHECK(csd_eq(expected.head, doc.head));
+
+        size_t len;
+        int64_t *ints = csd_array_as_int64(csd_at(doc.head, "ints"), &len);
+        TEST_CHECK(ints && len == 3 && ints[0] == 1 && ints[1] == -2 && ints[2] == 16);
+        double *floats = csd_array_as_double(csd_at(doc.head, "floats"), &len);
+        TEST_CHECK(floats && len == 2 && floats[1] == -2.25);
+        TEST_CHECK(!csd_array_as_double(csd_at(doc.head, "ints"), &len) && !len);
+
+        /* a mixed element, a string or no element at all keep tagged values */
+        TEST_CHECK(!csd_array_as_int64(csd_at(doc.head, "mixed"), &len));
+        TEST_CHECK(!csd_array_as_double(csd_at(doc.head, "mixed"), &len));
+        TEST_CHECK(!csd_array_as_int64(csd_at(doc.head, "empty"), &len));
+        TEST_CHECK(!csd_array_as_int64(csd_at(doc.head, "names"), &len));
+
+        csd_array nested = csd_at(doc.head, "nested")->value.as_array;
+        csd_value inner = csd_array_at(&nested, 1);
+        TEST_CHECK(csd_array_at(&inner.as_array, 0).as_float == 3.5);
+
+        /* a push unpacks the array, whatever the type of the new item */
+        csd_node *node = csd_at(doc.head, "ints");
+        csd_push(node, csd_vstring("four"));
+        TEST_CHECK(!csd_array_as_int64(node, &len) && csd_len(node) == 4);
+        TEST_CHECK(node->value.as_array[2].as_int == 16);
+        TEST_CHECK(node->value.as_array[3].type == csd_type_string);
+        csd_free(&doc);
+    }
+    csd_free(&expected);
+}
+
+typedef struct csd_test_counter
+{
+    size_t live;
+    size_t calls;
+    /* this call fails, counted from one, zero never fails */
+    size_t fail_at;
+} csd_test_counter;
+
+/* blocks are offset from malloc, one freed by the wrong allocator is noticed */
+#define csd_test_prefix 16
+
+static void *csd_test_alloc(void *user, size_t size)
+{
+    csd_test_counter *counter = user;
+    if (__atomic_add_fetch(&counter->calls, 1, __ATOMIC_RELAXED) == counter->fail_at)
+        return NULL;
+    __atomic_fetch_add(&counter->live, 1, __ATOMIC_RELAXED);
+    char *p = malloc(csd_test_prefix + size);
+    return p ? p + csd_test_prefix : NULL;
+}
+
+static void *csd_test_realloc(void *user, void *p, size_t size)
+{
+    csd_test_counter *counter = user;
+    if (__atomic_add_fetch(&counter->calls, 1, __ATOMIC_RELAXED) == counter->fail_at)
+        return NULL;
+    if (!p)
+        __atomic_fetch_add(&counter->live, 1, __ATOMIC_RELAXED);
+    char *block = p ? (char *)p - csd_test_prefix : NULL;
+    block = realloc(block, csd_test_prefix + size);
+    return block ? block + csd_test_prefix : NULL;
+}
+
+static void csd_test_free(void *user, void *p)
+{
+    csd_test_counter *counter = user;
+    __atomic_fetch_sub(&counter->live, 1, __ATOMIC_RELAXED);
+    free((char *)p - csd_test_prefix);
+}
+
+void csd_test_allocator(void)
+{
+    csd_test_counter counter = {0};
+    csd_allocator allocator = {csd_test_alloc, csd_test_realloc, csd_test_free, &counter};
+    char *source = csd_test_records(20000, true, -1);
+    csd_document expected = csd_parse_n(source, strlen(source), csd_parse_standard);
+
+    /* the arena, index, tape and parallel chunks all come from the allocator */
+    const int threads[] = {1, 4};
+    for (size_t i = 0; i < csd_array_sizeof(threads); i++) {
+        for (int tape = 0; tape < 2; tape++) {
+            csd_parse_options options = {.tape = tape, .threads = threads[i],
+                                         .allocator = &allocator};
+            size_t calls = counter.calls;
+            csd_document doc = csd_parse_n(source, strlen(source), options);
+            TEST_CHECK_(!doc.error, "%s", doc.reason);
+            TEST_CHECK(csd_eq(expected.head, doc.head));
+            TEST_CHECK(counter.calls > calls && counter.live > 0);
+            csd_free(&doc);
+            TEST_CHECK_(counter.live == 0, "%zu blocks left", counter.live);
+        }
+    }
+
+    /* a pool, a batch and a stream allocate from it too */
+    csd_pool *pool = csd_pool_new(4, &allocator);
+    csd_input input = {source, strlen(source)};
+    csd_document batched;
+    csd_parse_options pooled = {.pool = pool, .allocator = &allocator};
+    TEST_CHECK(csd_parse_batch(&input, 1, &batched, pool, pooled) == 0);
+    csd_document parallel = csd_parse_n(source, strlen(source), pooled);
+    TEST_CHECK(csd_eq(expected.head, batched.head));
+    TEST_CHECK(csd_eq(expected.head, parallel.head));
+    csd_free(&batched);
+    csd_free(&parallel);
+    csd_pool_free(pool);
+    TEST_CHECK_(counter.live == 0, "%zu blocks left", counter.live);
+
+    const char *records = "{id: 1} {id: 2} {id: }";
+    csd_stream s;
+    csd_document record = {0};
+    csd_stream_open(&s, records, strlen(records), &allocator);
+    s.reuse = true;
+    size_t calls = counter.calls;
+    while (csd_stream_next(&s, &record))
+        continue;
+    csd_stream_close(&s);
+    TEST_CHECK(s.error && counter.calls > calls);
+    TEST_CHECK_(counter.live == 0, "%zu blocks left", counter.live);
+
+    /* an owned source and the reason of a failure are released with it too */
+    csd_parse_options options = {.allocator = &allocator};
+    char *owned = csd_test_alloc(&counter, 16);
+    strcpy(owned, "{ a: [1, 2 }");
+    csd_document failed = csd_parse_x(owned, options);
+    TEST_CHECK(failed.error && failed.reason);
+    csd_free(&failed);
+    TEST_CHECK_(counter.live == 0, "%zu blocks left", counter.live);
+
+    /* the written string and decoded escapes come from the device allocator */
+    const char *window = "window { title: 'te\\ttris', width: 1920 }";
+    csd_document doc = csd_parse_n(window, strlen(window), options);
+    csd_write_device dev = csd_write_malloc_x(doc.head, csd_format_standard, &allocator);
+    TEST_CHECK(strstr(dev.string, "1920") != NULL);
+    csd_test_free(&counter, dev.string);
+    csd_free(&doc);
+    TEST_CHECK_(counter.live == 0, "%zu blocks left", counter.live);
+    csd_free(&expected);
+    free(source);
+}
+
+/* a parse given a failed allocation either recovers or fails with out of memory */
+static bool csd_test_out_of_memory_check(csd_test_counter *counter, csd_document *doc,
+                                         csd_node *expected)
+{
+    bool injected = counter->calls >= counter->fail_at;
+    if (doc->error) {
+        TEST_CHECK_(doc->error == csd_memory_error, "%s", doc->reason);
+        TEST_CHECK(doc->reason && strcmp(doc->reason, "out of memory") == 0);
+        TEST_CHECK(!doc->head);
+    } else {
+        TEST_CHECK(csd_eq(expected, doc->head));
+    }
+    csd_free(doc);
+    TEST_CHECK_(counter->live == 0, "%zu blocks left", counter->live);
+    return injected;
+}
+
+void csd_test_out_of_memory(void)
+{
+    csd_test_counter counter = {0};
+    csd_allocator allocator = {csd_test_alloc, csd_test_realloc, csd_test_free, &counter};
+    /* large enough for the parse given threads to split it */
+    char *source = csd_test_records(7000, true, -1);
+    size_t size = strlen(source);
+    csd_document expected = csd_parse_n(source, size, csd_parse_standard);
+
+    /* every allocation of the parse fails in turn, until one parse has none left */
+    const csd_parse_options options[] = {
+        {.allocator = &allocator},
+        {.tape = true, .allocator = &allocator},
+        {.packed_arrays = true, .allocator = &allocator},
+        {.threads = 4, .allocator = &allocator},
+    };
+    for (size_t i = 0; i < csd_array_sizeof(options); i++) {
+        for (size_t n = 1;; n++) {
+            counter = (csd_test_counter){.fail_at = n};
+            csd_document doc = csd_parse_n(source, size, options[i]);
+            if (!csd_test_out_of_memory_check(&counter, &doc, expected.head))
+                break;
+        }
+    }
+
+    const char *window = "window { title: 'te\\ttris', sizes: [1, 2, 3], w { h: 1 } }";
+    csd_document small = csd_parse_n(window, strlen(window), csd_parse_standard);
+    TEST_CHECK(!small.error);
+    csd_input input = {window, strlen(window)};
+    for (size_t n = 1;; n++) {
+        counter = (csd_test_counter){.fail_at = n};
+        csd_document doc;
+        csd_parse_batch(&input, 1, &doc, NULL, options[0]);
+        if (!csd_test_out_of_memory_check(&counter, &doc, small.head))
+            break;
+    }
+    for (size_t n = 1;; n++) {
+        counter = (csd_test_counter){.fail_at = n};
+        csd_parser p;
+        csd_parser_init(&p);
+        p.doc.allocator = &allocator;
+        for (size_t at = 0; at < input.size; at += 8)
+            csd_parser_feed(&p, &window[at], input.size - at < 8 ? input.size - at : 8);
+        csd_document doc = csd_parser_finish(&p);
+        if (!csd_test_out_of_memory_check(&counter, &doc, small.head))
+            break;
+    }
+
+    /* a device out of memory keeps what it wrote */
+    for (size_t n = 1;; n++) {
+        counter = (csd_test_counter){.fail_at = n};
+        csd_write_device dev =
+            csd_write_malloc_x(small.head, csd_format_standard, &allocator);
+        bool injected = counter.calls >= n;
+        TEST_CHECK(dev.status == (injected ? csd_memory_error : csd_ok));
+        if (dev.string)
+            csd_test_free(&counter, dev.string);
+        TEST_CHECK_(counter.live == 0, "%zu blocks left", counter.live);
+        if (!injected)
+            break;
+    }
+    csd_free(&small);
+    csd_free(&expected);
+    free(source);
 }
 
 TEST_LIST = {
     {"parse game.sd", &csd_test_parse_game},
+    {"parse tape", &csd_test_parse_tape},
+    {"parse keys", &csd_test_parse_keys},
+    {"parse error", &csd_test_parse_error},
+    {"numbers", &csd_test_numbers},
+    {"parse slice", &csd_test_parse_slice},
+    {"parse borrowed", &csd_test_parse_borrowed},
+    {"parse file", &csd_test_parse_file},
+    {"parse stream", &csd_test_parse_stream},
+    {"parser chunks", &csd_test_parser_chunks},
+    {"parser errors", &csd_test_parser_errors},
+    {"parse events", &csd_test_parse_events},
+    {"cursor", &csd_test_cursor},
+    {"parse lazy", &csd_test_parse_lazy},
+    {"parse select", &csd_test_parse_select},
+    {"parse parallel", &csd_test_parse_parallel},
+    {"parse batch", &csd_test_parse_batch},
+    {"pool nested", &csd_test_pool_nested},
+    {"stream next", &csd_test_stream_next},
+    {"parse depth", &csd_test_parse_depth},
+    {"arena", &csd_test_arena},
+    {"allocator", &csd_test_allocator},
+    {"out of memory", &csd_test_out_of_memory},
+    {"value layout", &csd_test_value_layout},
+    {"packed arrays", &csd_test_packed_arrays},
     {NULL, NULL},
 };
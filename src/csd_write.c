@@ -4,7 +4,10 @@
 
 #define csd_max(a, b) ((a) > (b) ? (a) : (b))
 #define csd_min(a, b) ((a) < (b) ? (a) : (b))
-void csd_write_escaped(csd_write_device *dev, const char *s);
+void csd_write_escaped(csd_write_device *dev, const char *s, size_t size);
+void *csd_mem_alloc(const csd_allocator *a, size_t size);
+void *csd_mem_realloc(const csd_allocator *a, void *p, size_t size);
+void csd_mem_free(const csd_allocator *a, void *p);
 
 void csd_write_indent(csd_write_device *dev, const char *indent, int depth)
 {
@@ -24,9 +27,10 @@ void csd_write_value(csd_write_device *dev, csd_value *v, int depth)
     case csd_type_array: {
         csd_array a = v->as_array;
         dev->writer(dev, fmt->array_begin);
-        for (size_t i = 0; csd_array_len(&a); i++) {
+        for (size_t i = 0; i < csd_array_len(&a); i++) {
+            csd_value item = csd_array_at(&a, i);
             csd_write_indent(dev, fmt->array_indent, depth);
-            csd_write_value(dev, &a[i], depth + 1);
+            csd_write_value(dev, &item, depth + 1);
 
             if (i < csd_array_len(&a) - 1)
                 dev->writer(dev, fmt->array_comma);
@@ -63,11 +67,23 @@ void csd_write_value(csd_write_device *dev, csd_value *v, int depth)
         dev->writer(dev, "%s", v->as_boolean ? "true" : "false");
         break;
 
-    case csd_type_string:
+    case csd_type_string: {
+        csd_string s = csd_raw_string(v);
+        char *decoded = NULL;
+        if (s.escaped) {
+            decoded = csd_mem_alloc(dev->allocator, s.size + 1);
+            if (!decoded) {
+                dev->status = csd_memory_error;
+                break;
+            }
+            s = (csd_string){decoded, csd_unescape(decoded, s.data, s.size), false};
+        }
+
         dev->writer(dev, fmt->quote);
-        csd_write_escaped(dev, v->as_string);
+        csd_write_escaped(dev, s.data, s.size);
         dev->writer(dev, fmt->quote);
-        break;
+        csd_mem_free(dev->allocator, decoded);
+    } break;
 
     case csd_type_end:
         break;
@@ -76,6 +92,9 @@ void csd_write_value(csd_write_device *dev, csd_value *v, int depth)
 
 void csd_write_x(csd_write_device *dev, csd_node *node, int depth)
 {
+    if (!node)
+        return dev->writer(dev, "nil");
+
     csd_value *v = &node->value;
     csd_write_format *fmt = &dev->format;
 
@@ -89,7 +108,7 @@ void csd_write_x(csd_write_device *dev, csd_node *node, int depth)
 csd_write_device csd_write_stream(FILE *f, csd_node *node, csd_write_format format)
 {
     csd_write_device dev = (csd_write_device){
-        &csd_stream_writer, f, NULL, format, csd_ok,
+        &csd_stream_writer, f, NULL, format, csd_ok, NULL,
     };
     return csd_write_x(&dev, node, 0), dev;
 }
@@ -99,20 +118,29 @@ csd_write_device csd_write_string(char *buf, size_t size, csd_node *node,
 {
     csd_write_string_backend backend = (csd_write_string_backend){0, size, size, 0};
     csd_write_device dev = (csd_write_device){
-        &csd_string_writer, &backend, buf, format, csd_ok,
+        &csd_string_writer, &backend, buf, format, csd_ok, NULL,
     };
     return csd_write_x(&dev, node, 0), dev;
 }
 
 csd_write_device csd_write_malloc(csd_node *node, csd_write_format format)
+{
+    return csd_write_malloc_x(node, format, NULL);
+}
+
+csd_write_device csd_write_malloc_x(csd_node *node, csd_write_format format,
+                                    const csd_allocator *allocator)
 {
     csd_write_malloc_backend backend = (csd_write_malloc_backend){
         0,
         csd_write_malloc_init_cap,
     };
     csd_write_device dev = (csd_write_device){
-        &csd_malloc_writer, &backend, malloc(backend.capacity), format, csd_ok,
+        &csd_malloc_writer, &backend, csd_mem_alloc(allocator, backend.capacity),
+        format, csd_ok, allocator,
     };
+    if (!dev.string)
+        return dev.status = csd_memory_error, dev;
     return csd_write_x(&dev, node, 0), dev;
 }
 
@@ -153,33 +181,45 @@ void csd_malloc_writer(csd_write_device *dev, const char *format, ...)
     size_t remaining;
     size_t written;
     char *it;
-    va_list args;
+    va_list args, retry;
+    /* out of memory the string keeps what was written before */
+    if (dev->status == csd_memory_error)
+        return;
     va_start(args, format);
 
 resized:
+    va_copy(retry, args);
     remaining = backend->capacity - backend->length;
-    written = vsnprintf(&dev->string[backend->length], remaining, format, args);
-
-    if (backend->length + written > backend->capacity) {
-        backend->capacity *= 2;
-        dev->string = realloc(dev->string, backend->capacity);
-        goto resized;
+    written = vsnprintf(&dev->string[backend->length], remaining, format, retry);
+    va_end(retry);
+
+    if (backend->length + written >= backend->capacity) {
+        char *grown = csd_mem_realloc(dev->allocator, dev->string, 2 * backend->capacity);
+        if (!grown) {
+            dev->string[backend->length] = '\0';
+            dev->status = csd_memory_error;
+        } else {
+            dev->string = grown;
+            backend->capacity *= 2;
+            goto resized;
+        }
     } else {
         backend->length += written;
     }
     va_end(args);
 }
 
-void csd_write_escaped(csd_write_device *dev, const char *s)
+void csd_write_escaped(csd_write_device *dev, const char *s, size_t size)
 {
-    while (*s) {
-        const char *seq = strpbrk(s, csd_escape_sequences);
-        if (!seq) {
-            dev->writer(dev, s);
-            s = s + strlen(s);
-        } else {
-            dev->writer(dev, "%*s%s", seq - s, s, csd_char_to_escape_sequence[*seq]);
-            s = seq + 1;
-        }
+    const char *end = s + size;
+
+    while (s < end) {
+        const char *run = s;
+        while (s < end && !csd_escape_sequence_to_char[(uint8_t)*s])
+            s++;
+        if (s > run)
+            dev->writer(dev, "%.*s", (int)(s - run), run);
+        if (s < end)
+            dev->writer(dev, "%s", csd_escape_sequence_to_char[(uint8_t)*s++]);
     }
 }